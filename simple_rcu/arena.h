@@ -0,0 +1,313 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_ARENA_H
+#define _SIMPLE_RCU_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/utility/utility.h"
+#include "simple_rcu/rcu.h"
+#include "simple_rcu/stats_policy.h"
+
+namespace simple_rcu {
+
+// Bump allocator that releases all its memory at once by `Reset()`.
+//
+// Memory is taken from blocks of `block_size` bytes (or more for larger
+// allocations), so that a value built from many small allocations is kept
+// together and releasing it costs O(blocks) instead of a deallocation per
+// allocation.
+//
+// Thread-compatible (but not thread-safe).
+class Arena final {
+ public:
+  static constexpr size_t kDefaultBlockSize = 4096;
+
+  explicit Arena(size_t block_size = kDefaultBlockSize)
+      : block_size_(block_size),
+        blocks_(nullptr),
+        next_(nullptr),
+        end_(nullptr),
+        destructors_(nullptr) {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  ~Arena() { Reset(); }
+
+  // Returns uninitialized memory of `size` bytes aligned to `alignment`, which
+  // must be a power of 2. It's valid until `Reset()`.
+  void* Allocate(size_t size, size_t alignment) {
+    char* result = Align(next_, alignment);
+    if (result == nullptr || result + size > end_) {
+      NewBlock(size + alignment);
+      result = Align(next_, alignment);
+    }
+    next_ = result + size;
+    return result;
+  }
+
+  // Constructs `T(args...)` in the arena. Unless `T` is trivially
+  // destructible, it's destroyed by `Reset()`, in the reverse order of
+  // construction.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    T* object = new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      Destructor* destructor = new (
+          Allocate(sizeof(Destructor), alignof(Destructor))) Destructor{
+          [](void* object) { static_cast<T*>(object)->~T(); }, object,
+          destructors_};
+      destructors_ = destructor;
+    }
+    return object;
+  }
+
+  // Destroys all objects constructed by `New` and releases all memory.
+  void Reset() noexcept {
+    for (Destructor* destructor = destructors_; destructor != nullptr;
+         destructor = destructor->next) {
+      destructor->destroy(destructor->object);
+    }
+    destructors_ = nullptr;
+    while (blocks_ != nullptr) {
+      Block* next = blocks_->next;
+      ::operator delete(blocks_);
+      blocks_ = next;
+    }
+    next_ = nullptr;
+    end_ = nullptr;
+  }
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  struct Destructor {
+    void (*destroy)(void*);
+    void* object;
+    Destructor* next;
+  };
+
+  static char* Align(char* pointer, size_t alignment) noexcept {
+    if (pointer == nullptr) {
+      return nullptr;
+    }
+    const uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+    return pointer + ((alignment - address % alignment) % alignment);
+  }
+
+  // Allocates a block with at least `size` bytes available.
+  void NewBlock(size_t size) {
+    const size_t bytes = sizeof(Block) + std::max(size, block_size_);
+    Block* block = static_cast<Block*>(::operator new(bytes));
+    block->next = blocks_;
+    blocks_ = block;
+    next_ = reinterpret_cast<char*>(block + 1);
+    end_ = reinterpret_cast<char*>(block) + bytes;
+  }
+
+  const size_t block_size_;
+  // Allocated blocks, the current one first.
+  Block* blocks_;
+  // The free memory of the current block.
+  char* next_;
+  char* end_;
+  // Objects to be destroyed by `Reset()`, the last constructed one first.
+  // Allocated in the arena itself.
+  Destructor* destructors_;
+};
+
+// Standard allocator that allocates from an `Arena`, so that containers
+// within a value built in the arena keep their memory there too.
+// Deallocation is a no-op, the memory is released by `Arena::Reset()`.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena& arena) noexcept : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+      : arena_(other.arena_) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) noexcept {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>& other) const noexcept {
+    return arena_ == other.arena_;
+  }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>& other) const noexcept {
+    return arena_ != other.arena_;
+  }
+
+ private:
+  Arena* arena_;
+
+  template <typename U>
+  friend class ArenaAllocator;
+};
+
+// Publishes values of `Rcu<const T*>` built in per-generation arenas.
+//
+// Each `Update` builds a new value in an `Arena` and makes it the current value
+// of the RCU. The arena of the previous value is then reset by `Rcu::CallRcu`
+// once no reader can observe the previous value any more, and kept for reuse by
+// a later `Update`. This avoids allocating a `std::shared_ptr` control block
+// for each value, and releasing a value is a single arena reset.
+//
+// Values are passed as plain pointers ("generations"), since copies of a value
+// held by the `Local` instances aren't destroyed before the arena is reset.
+//
+// Thread-safe.
+template <typename T, typename Stats = NoRcuStats>
+class GenerationArenas final {
+ private:
+  struct Generation;
+
+  // Resets the arena of a generation and returns it to its pool.
+  struct Release {
+    void operator()(Generation* generation) const noexcept {
+      Pool::Release(generation);
+    }
+  };
+
+ public:
+  // `rcu` must outlive this instance. Values are released only when it
+  // doesn't refer to them any more, at the latest by its destructor.
+  explicit GenerationArenas(Rcu<const T*, Stats>& rcu,
+                            size_t block_size = Arena::kDefaultBlockSize)
+      : rcu_(rcu),
+        block_size_(block_size),
+        pool_(std::make_shared<Pool>()),
+        lock_(),
+        current_() {}
+  // Releases the arena of the current value. After that `rcu` must not be read
+  // any more.
+  ~GenerationArenas() {
+    current_.reset();
+    pool_->Close();
+  }
+
+  // Calls `build(Arena&)`, which returns a `const T*` to a new value built in
+  // the given arena, and updates `rcu` to it.
+  template <typename F>
+  void Update(F&& build) LOCKS_EXCLUDED(lock_) {
+    std::unique_ptr<Generation, Release> generation(
+        pool_->Take(pool_, block_size_));
+    const T* value = std::forward<F>(build)(generation->arena);
+    absl::MutexLock mutex(&lock_);
+    rcu_.Update(value);
+    Generation* previous = current_.release();
+    current_ = std::move(generation);
+    if (previous != nullptr) {
+      // Captures just a pointer, which `std::function` stores without
+      // allocating.
+      rcu_.CallRcu([previous]() { Pool::Release(previous); });
+    }
+  }
+
+ private:
+  // Arenas of released generations available for reuse. Shared with the
+  // generations, since pending `CallRcu` callbacks can outlive this instance.
+  class Pool final {
+   public:
+    Pool() : lock_(), closed_(false), free_(nullptr) {}
+
+    // Returns a released generation, or a new one if there is none.
+    Generation* Take(const std::shared_ptr<Pool>& self, size_t block_size)
+        LOCKS_EXCLUDED(lock_) {
+      {
+        absl::MutexLock mutex(&lock_);
+        if (free_ != nullptr) {
+          return absl::exchange(free_, free_->next);
+        }
+      }
+      return new Generation(self, block_size);
+    }
+
+    // Resets the arena of `generation` and keeps it for reuse, or deletes it
+    // if the pool has been closed.
+    static void Release(Generation* generation) noexcept {
+      generation->arena.Reset();
+      Pool& pool = *generation->pool;
+      {
+        absl::MutexLock mutex(&pool.lock_);
+        if (!pool.closed_) {
+          generation->next = pool.free_;
+          pool.free_ = generation;
+          return;
+        }
+      }
+      // Might destroy the pool, so it must be done without its lock.
+      delete generation;
+    }
+
+    // Deletes all released generations. Generations released afterwards are
+    // deleted by `Release`.
+    void Close() LOCKS_EXCLUDED(lock_) {
+      Generation* free;
+      {
+        absl::MutexLock mutex(&lock_);
+        closed_ = true;
+        free = absl::exchange(free_, nullptr);
+      }
+      while (free != nullptr) {
+        delete absl::exchange(free, free->next);
+      }
+    }
+
+   private:
+    absl::Mutex lock_;
+    bool closed_ GUARDED_BY(lock_);
+    // Singly linked by `Generation::next`.
+    Generation* free_ GUARDED_BY(lock_);
+  };
+
+  struct Generation {
+    Generation(std::shared_ptr<Pool> pool_, size_t block_size)
+        : arena(block_size), pool(std::move(pool_)), next(nullptr) {}
+
+    Arena arena;
+    const std::shared_ptr<Pool> pool;
+    // The next released generation in `Pool`.
+    Generation* next;
+  };
+
+  Rcu<const T*, Stats>& rcu_;
+  const size_t block_size_;
+  const std::shared_ptr<Pool> pool_;
+  // Serializes `Update` calls, so that generations are retired in the order
+  // of their values.
+  absl::Mutex lock_;
+  // The generation of the current value of `rcu_`, if it has been set by
+  // `Update`.
+  std::unique_ptr<Generation, Release> current_ GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_ARENA_H
@@ -0,0 +1,127 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/arena.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(ArenaTest, AllocatesAligned) {
+  Arena arena(/*block_size=*/64);
+  for (size_t alignment : {1, 2, 8, 64, 256}) {
+    SCOPED_TRACE(alignment);
+    void* memory = arena.Allocate(3, alignment);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(memory) % alignment, 0);
+  }
+  char* large = static_cast<char*>(arena.Allocate(1000, 1));
+  large[999] = 1;
+}
+
+struct Destroyed {
+  Destroyed(std::vector<int>& destroyed_, int id_)
+      : destroyed(destroyed_), id(id_) {}
+  ~Destroyed() { destroyed.push_back(id); }
+
+  std::vector<int>& destroyed;
+  int id;
+};
+
+TEST(ArenaTest, ResetDestroysInReverseOrder) {
+  std::vector<int> destroyed;
+  Arena arena;
+  arena.New<Destroyed>(destroyed, 1);
+  EXPECT_EQ(*arena.New<int>(42), 42);
+  arena.New<Destroyed>(destroyed, 2);
+  EXPECT_TRUE(destroyed.empty());
+  arena.Reset();
+  EXPECT_EQ(destroyed, (std::vector<int>{2, 1}));
+  arena.New<Destroyed>(destroyed, 3);
+  arena.Reset();
+  EXPECT_EQ(destroyed, (std::vector<int>{2, 1, 3}))
+      << "The arena must be usable after Reset()";
+}
+
+TEST(ArenaTest, ArenaAllocator) {
+  Arena arena;
+  std::vector<int, ArenaAllocator<int>> values{ArenaAllocator<int>(arena)};
+  for (int i = 0; i < 1000; i++) {
+    values.push_back(i);
+  }
+  EXPECT_EQ(values[999], 999);
+  EXPECT_TRUE(values.get_allocator() == ArenaAllocator<char>(arena));
+}
+
+struct Config {
+  Config(std::atomic<int>& destroyed_, int value_)
+      : destroyed(destroyed_), value(value_) {}
+  ~Config() { destroyed++; }
+
+  std::atomic<int>& destroyed;
+  int value;
+};
+
+TEST(GenerationArenasTest, ReleasesAfterGracePeriod) {
+  std::atomic<int> destroyed(0);
+  {
+    Rcu<const Config*> rcu(nullptr);
+    GenerationArenas<Config> arenas(rcu);
+    Rcu<const Config*>::Local local(rcu);
+    arenas.Update(
+        [&](Arena& arena) { return arena.New<Config>(destroyed, 1); });
+    EXPECT_EQ((*local.Read())->value, 1);
+    arenas.Update(
+        [&](Arena& arena) { return arena.New<Config>(destroyed, 2); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(destroyed.load(), 0)
+        << "The reader hasn't obtained the new value yet";
+    EXPECT_EQ((*local.Read())->value, 2);
+    for (int i = 0; i < 1000 && destroyed.load() == 0; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(destroyed.load(), 1);
+  }
+  EXPECT_EQ(destroyed.load(), 2);
+}
+
+TEST(GenerationArenasTest, ReusesReleasedArenas) {
+  std::atomic<int> destroyed(0);
+  Rcu<const Config*> rcu(nullptr);
+  GenerationArenas<Config> arenas(rcu);
+  std::vector<Arena*> used;
+  auto build = [&](Arena& arena) {
+    used.push_back(&arena);
+    return arena.New<Config>(destroyed, 0);
+  };
+  arenas.Update(build);
+  arenas.Update(build);
+  // Without any `Local`, the grace period passes right away.
+  for (int i = 0; i < 1000 && destroyed.load() == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(destroyed.load(), 1);
+  arenas.Update(build);
+  EXPECT_EQ(used[2], used[0]) << "The released arena should be reused";
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,166 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_HIERARCHICAL_RCU_H
+#define _SIMPLE_RCU_HIERARCHICAL_RCU_H
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "simple_rcu/numa.h"
+#include "simple_rcu/rcu.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+
+// Variants of `Rcu` and `ReverseRcu` for machines with multiple NUMA nodes.
+//
+// `Local` instances are grouped by the NUMA node they're registered on. Each
+// group is a separate `Rcu` (or `ReverseRcu`) instance, operated by a worker
+// thread pinned to its node. Therefore distributing (or collecting) values
+// within a group only touches memory local to the node, and only O(nodes)
+// values cross between nodes.
+//
+// A `Local` is registered on the node of the CPU it's constructed on, so reader
+// (writer) threads should be pinned to their nodes, for example by
+// `PinCurrentThread`. A thread that has migrated to another node still
+// works correctly, just without the benefits of memory locality.
+//
+// Each operation wakes up all the worker threads, which adds latency of
+// context switches. It pays off only with many `Local` instances per node.
+
+// Hierarchical variant of `Rcu<T>` with the same `Local`/`Snapshot` interface.
+template <typename T>
+class HierarchicalRcu final {
+ public:
+  using MutableT = typename Rcu<T>::MutableT;
+  using Snapshot = typename Rcu<T>::Snapshot;
+
+  // Interface to the RCU local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the `Read()`
+  // method is only thread-compatible.
+  class Local final {
+   public:
+    // Registers to the group of the node the current thread is running on.
+    explicit Local(HierarchicalRcu& rcu)
+        : Local(rcu, rcu.topology_.CurrentNode()) {}
+    // Registers to the group of `node`.
+    Local(HierarchicalRcu& rcu, int node) : local_(*rcu.groups_[node]) {}
+
+    // Obtains a read snapshot to the current value held by the RCU.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Read() noexcept { return local_.Read(); }
+
+   private:
+    typename Rcu<T>::Local local_;
+  };
+
+  explicit HierarchicalRcu(NumaTopology topology = NumaTopology::FromSystem(),
+                           MutableT initial_value = MutableT())
+      : topology_(std::move(topology)),
+        workers_(topology_),
+        groups_(topology_.nodes()) {
+    // Allocate each group on its node.
+    workers_.RunOnEach([this, &initial_value](int node) {
+      groups_[node].reset(new Rcu<T>(initial_value));
+    });
+  }
+
+  const NumaTopology& topology() const noexcept { return topology_; }
+
+  // Updates `value` in all registered `Local` threads. Each node copies
+  // `value` once and distributes it to its group in parallel with the others.
+  //
+  // Thread-safe.
+  void Update(const MutableT& value) {
+    workers_.RunOnEach(
+        [this, &value](int node) { groups_[node]->Update(value); });
+  }
+
+ private:
+  const NumaTopology topology_;
+  NodeWorkers workers_;
+  // Indexed by node.
+  std::vector<std::unique_ptr<Rcu<T>>> groups_;
+};
+
+// Hierarchical variant of `ReverseRcu<T>` with the same `Local`/`Snapshot`
+// interface.
+template <typename T>
+class HierarchicalReverseRcu final {
+ public:
+  using Snapshot = typename ReverseRcu<T>::Snapshot;
+
+  // Interface to the RCU local to a particular writer thread.
+  // Construction and destruction are thread-safe operations, but the `Write()`
+  // method is only thread-compatible.
+  class Local final {
+   public:
+    // Registers to the group of the node the current thread is running on.
+    explicit Local(HierarchicalReverseRcu& rcu)
+        : Local(rcu, rcu.topology_.CurrentNode()) {}
+    // Registers to the group of `node`.
+    Local(HierarchicalReverseRcu& rcu, int node)
+        : local_(*rcu.groups_[node]) {}
+
+    // Obtains a write snapshot to the local value to be collected by the RCU.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Write() noexcept { return local_.Write(); }
+
+   private:
+    typename ReverseRcu<T>::Local local_;
+  };
+
+  explicit HierarchicalReverseRcu(
+      NumaTopology topology = NumaTopology::FromSystem())
+      : topology_(std::move(topology)),
+        workers_(topology_),
+        groups_(topology_.nodes()) {
+    // Allocate each group on its node.
+    workers_.RunOnEach(
+        [this](int node) { groups_[node].reset(new ReverseRcu<T>()); });
+  }
+
+  const NumaTopology& topology() const noexcept { return topology_; }
+
+  // Reads values from all registered `Local` instances, including ones that
+  // have been destroyed since the last call. Each node collects a partial
+  // value from its group in parallel with the others, and only the partial
+  // values are combined.
+  //
+  // Thread-safe.
+  T Collect() {
+    std::vector<T> partial(groups_.size());
+    workers_.RunOnEach([this, &partial](int node) {
+      partial[node] = groups_[node]->Collect();
+    });
+    T value = T();
+    for (T& node_value : partial) {
+      value += std::move(node_value);
+    }
+    return value;
+  }
+
+ private:
+  const NumaTopology topology_;
+  NodeWorkers workers_;
+  // Indexed by node.
+  std::vector<std::unique_ptr<ReverseRcu<T>>> groups_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_HIERARCHICAL_RCU_H
@@ -0,0 +1,59 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/hierarchical_rcu.h"
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+// Two nodes sharing the same CPU, so that the tests run anywhere.
+NumaTopology TwoNodes() { return NumaTopology({{0}, {0}}); }
+
+TEST(HierarchicalRcuTest, UpdateAndRead) {
+  HierarchicalRcu<int> rcu(TwoNodes());
+  HierarchicalRcu<int>::Local local1(rcu, 0);
+  rcu.Update(42);
+  HierarchicalRcu<int>::Local local2(rcu, 1);
+  HierarchicalRcu<int>::Local local3(rcu);
+  EXPECT_EQ(*local1.Read(), 42)
+      << "Thread registered prior Update must receive the value";
+  EXPECT_EQ(*local2.Read(), 42)
+      << "Thread registered after Update must also receive the value";
+  EXPECT_EQ(*local3.Read(), 42)
+      << "Thread registered on the current node must receive the value";
+}
+
+TEST(HierarchicalRcuTest, InitialValue) {
+  HierarchicalRcu<int> rcu(TwoNodes(), 42);
+  HierarchicalRcu<int>::Local local(rcu, 1);
+  EXPECT_EQ(*local.Read(), 42);
+}
+
+TEST(HierarchicalReverseRcuTest, WriteAndCollect) {
+  HierarchicalReverseRcu<int> rcu(TwoNodes());
+  HierarchicalReverseRcu<int>::Local local1(rcu, 0);
+  {
+    HierarchicalReverseRcu<int>::Local local2(rcu, 1);
+    *local2.Write() += 10;
+  }
+  *local1.Write() += 1;
+  EXPECT_EQ(rcu.Collect(), 11)
+      << "Should receive values from both nodes and terminated threads";
+  EXPECT_EQ(rcu.Collect(), 0);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,169 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_KEYED_REVERSE_RCU_H
+#define _SIMPLE_RCU_KEYED_REVERSE_RCU_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+
+// Variant of `ReverseRcu` that collects a separate value `V` for each key `K`,
+// such as a metric with labels.
+//
+// Keys are first interned into dense ids by `Intern`, which is meant to be
+// done once per key, for example when a label set is first seen. Writes then
+// refer to keys by their ids, so that they don't need to hash keys at all.
+// Each `Local` keeps its values in a table indexed by ids, together with the
+// list of ids written since it handed its table over to `Collect`. Therefore
+// `Collect` merges only values that have actually been written, and clears
+// just their slots, so that a `Local` allocates only when it writes an id
+// higher than any before.
+//
+// `V` must be default constructible and define `V& operator+=(V&&)` (or a
+// variant with any compatible argument type).
+template <typename K, typename V>
+class KeyedReverseRcu {
+ public:
+  using Id = uint32_t;
+
+ private:
+  // Values written by a single `Local`, or collected from several of them.
+  struct Table {
+    Table() : values(), written(), ids() {}
+
+    Table& operator+=(Table&& other) {
+      for (Id id : other.ids) {
+        Add(id, std::move(other.values[id]));
+      }
+      return *this;
+    }
+    Table& operator+=(std::pair<Id, V>&& delta) {
+      Add(delta.first, std::move(delta.second));
+      return *this;
+    }
+
+    void Add(Id id, V&& delta) {
+      if (id >= values.size()) {
+        values.resize(id + 1);
+        written.resize(id + 1, false);
+      }
+      if (!written[id]) {
+        written[id] = true;
+        ids.push_back(id);
+      }
+      values[id] += std::move(delta);
+    }
+
+    // Moves out only the written values and clears them in place, so that
+    // the writer handed `table` back keeps its allocated capacity.
+    friend Table TakeAndReset(Table& table) {
+      Table taken;
+      for (Id id : table.ids) {
+        taken.Add(id, std::move(table.values[id]));
+        table.values[id] = V();
+        table.written[id] = false;
+      }
+      table.ids.clear();
+      return taken;
+    }
+
+    // Indexed by ids.
+    std::vector<V> values;
+    std::vector<bool> written;
+    // Ids for which `written` is set, in the order of their first write.
+    std::vector<Id> ids;
+  };
+
+ public:
+  // Interface to the RCU, local to a particular writer thread.
+  // Construction and destruction are thread-safe operations, but the `Add()`
+  // method is only thread-compatible.
+  class Local final {
+   public:
+    // See `ReverseRcu::Local` for `writes_per_handoff`.
+    explicit Local(KeyedReverseRcu& rcu, uint_fast32_t writes_per_handoff = 1)
+        : rcu_(rcu), local_(rcu.rcu_, writes_per_handoff) {}
+
+    // Adds `delta` to the value of the key interned as `id`. Allocates only
+    // while the tables of this `Local` grow to the highest id it writes.
+    //
+    // `id` must have been returned by `Intern` of the same `KeyedReverseRcu`.
+    void Add(Id id, V delta) {
+      assert(id < rcu_.interned_.load(std::memory_order_relaxed));
+      local_.Add(std::make_pair(id, std::move(delta)));
+    }
+
+   private:
+    KeyedReverseRcu& rcu_;
+    typename ReverseRcu<Table>::Local local_;
+  };
+
+  KeyedReverseRcu() : lock_(), ids_(), keys_(), interned_(0), rcu_() {}
+
+  // Returns the id of `key`, assigning a new one if `key` hasn't been interned
+  // yet. Ids are assigned densely from 0.
+  //
+  // Thread-safe.
+  Id Intern(const K& key) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    auto inserted = ids_.emplace(key, static_cast<Id>(keys_.size()));
+    if (inserted.second) {
+      keys_.push_back(key);
+      interned_.store(static_cast<Id>(keys_.size()), std::memory_order_relaxed);
+    }
+    return inserted.first->second;
+  }
+
+  // Collects values from all registered `Local` instances, as
+  // `ReverseRcu::Collect` does. Returns the collected values of keys that have
+  // been written, ordered by their ids.
+  //
+  // Thread-safe.
+  std::vector<std::pair<K, V>> Collect() LOCKS_EXCLUDED(lock_) {
+    Table table = rcu_.Collect();
+    std::sort(table.ids.begin(), table.ids.end());
+    std::vector<std::pair<K, V>> result;
+    result.reserve(table.ids.size());
+    absl::MutexLock mutex(&lock_);
+    for (Id id : table.ids) {
+      assert(id < keys_.size());
+      result.emplace_back(keys_[id], std::move(table.values[id]));
+    }
+    return result;
+  }
+
+ private:
+  absl::Mutex lock_;
+  absl::flat_hash_map<K, Id> ids_ GUARDED_BY(lock_);
+  // Interned keys indexed by their ids.
+  std::deque<K> keys_ GUARDED_BY(lock_);
+  // The size of `keys_`, for checking ids in `Local::Add` without `lock_`.
+  std::atomic<Id> interned_;
+  ReverseRcu<Table> rcu_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_KEYED_REVERSE_RCU_H
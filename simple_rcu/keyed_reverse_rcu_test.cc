@@ -0,0 +1,111 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/keyed_reverse_rcu.h"
+
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::Pair;
+
+TEST(KeyedReverseRcuTest, InternAssignsDenseIds) {
+  KeyedReverseRcu<std::string, int> rcu;
+  EXPECT_EQ(rcu.Intern("a"), 0);
+  EXPECT_EQ(rcu.Intern("b"), 1);
+  EXPECT_EQ(rcu.Intern("a"), 0);
+}
+
+TEST(KeyedReverseRcuTest, AddAndCollect) {
+  KeyedReverseRcu<std::string, int> rcu;
+  const auto a = rcu.Intern("a");
+  const auto b = rcu.Intern("b");
+  const auto c = rcu.Intern("c");
+  {
+    KeyedReverseRcu<std::string, int>::Local local1(rcu);
+    local1.Add(c, 1);
+    KeyedReverseRcu<std::string, int>::Local local2(rcu);
+    local2.Add(a, 2);
+  }
+  EXPECT_THAT(rcu.Collect(), ElementsAre(Pair("a", 2), Pair("c", 1)))
+      << "Should receive only written keys, ordered by ids";
+  {
+    KeyedReverseRcu<std::string, int>::Local local(rcu);
+    local.Add(b, 3);
+    local.Add(b, 4);
+  }
+  EXPECT_THAT(rcu.Collect(), ElementsAre(Pair("b", 7)))
+      << "Should receive only keys written since the last collect";
+  EXPECT_THAT(rcu.Collect(), IsEmpty());
+}
+
+TEST(KeyedReverseRcuTest, LiveLocalReusesClearedTables) {
+  KeyedReverseRcu<std::string, int> rcu;
+  const auto a = rcu.Intern("a");
+  const auto b = rcu.Intern("b");
+  KeyedReverseRcu<std::string, int>::Local local(rcu);
+  for (int round = 0; round < 6; round++) {
+    const bool even = round % 2 == 0;
+    local.Add(even ? a : b, round);
+    EXPECT_THAT(rcu.Collect(), ElementsAre(Pair(even ? "a" : "b", round)))
+        << "Values of previous rounds must have been cleared, round " << round;
+  }
+}
+
+TEST(KeyedReverseRcuTest, ConcurrentAddAndCollect) {
+  static constexpr int kThreads = 4;
+  static constexpr int kAdds = 1000;
+  KeyedReverseRcu<int, int> rcu;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&rcu, i]() {
+      const auto own = rcu.Intern(i);
+      const auto shared = rcu.Intern(-1);
+      KeyedReverseRcu<int, int>::Local local(rcu);
+      for (int j = 0; j < kAdds; j++) {
+        local.Add(own, 1);
+        local.Add(shared, 1);
+      }
+    });
+  }
+  std::vector<int> totals(kThreads + 1);
+  auto collect = [&]() {
+    for (const auto& entry : rcu.Collect()) {
+      totals[entry.first + 1] += entry.second;
+    }
+  };
+  for (int i = 0; i < 10; i++) {
+    collect();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  collect();
+  EXPECT_EQ(totals[0], kThreads * kAdds);
+  for (int i = 1; i <= kThreads; i++) {
+    EXPECT_EQ(totals[i], kAdds);
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu
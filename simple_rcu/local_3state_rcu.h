@@ -17,9 +17,33 @@
 
 #include <array>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace simple_rcu {
 
+// Assumed size of a cache line, used to keep variables accessed by different
+// threads apart, avoiding false sharing.
+#ifdef __cpp_lib_hardware_interference_size
+// GCC warns that the value can differ between compilation units built with
+// different tuning flags. Such units shouldn't share aligned instances.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr std::size_t kCacheLineSize =
+    std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr std::size_t kCacheLineSize = 64;
+#endif
+
 // Provides a RCU-like framework to exchange values between just two threads
 // "Reader" and "Updater" (hence "Local"). It consists of 3 instances of `T`
 // such that:
@@ -47,7 +71,16 @@ namespace simple_rcu {
 // instances of `T` internally between the two threads. If they need to be
 // constructed and deconstructed as they pass between the Updater and the
 // Reader, wrap `T` into `absl::optional` or `std::unique_ptr`.
-template <typename T>
+//
+// If `kAlignToCacheLines` is `true`, each of the 3 instances of `T`, the
+// variables accessed only by the Reader, only by the Updater, and by both of
+// them are aligned to separate cache lines. This prevents false sharing between
+// the two threads at the cost of larger memory footprint. Note that before
+// C++17 `new` doesn't respect such alignment, so in this case instances should
+// be allocated statically, on the stack or as `thread_local` variables.
+//
+// Trivially copyable types of at most 8 bytes use a specialization below.
+template <typename T, bool kAlignToCacheLines = false, typename = void>
 class Local3StateRcu {
  public:
   // Builds an instance by initializing the internal three `T` variables to
@@ -61,7 +94,9 @@ class Local3StateRcu {
   //
   // `T` must be moveable.
   Local3StateRcu(T read, T update, T reclaim)
-      : values_{std::move(read), std::move(update), std::move(reclaim)},
+      : values_{{{std::move(read)},
+                 {std::move(update)},
+                 {std::move(reclaim)}}},
         next_read_index_(kNullIndex),
         read_{.index = 0},
         update_{.index = 1, .next_index = 0} {}
@@ -79,7 +114,7 @@ class Local3StateRcu {
   ~Local3StateRcu() noexcept = default;
 
   // Reference to the value that can be manipulated by the reading thread.
-  T& Read() noexcept { return values_[read_.index]; }
+  T& Read() noexcept { return values_[read_.index].value; }
 
   // Advance the Reader to a new value, if possible.
   //
@@ -94,6 +129,11 @@ class Local3StateRcu {
   // See also `TryUpdate()` which has the same semantics for the updater
   // thread.
   bool TryRead() noexcept {
+    // Avoid taking ownership of the cache line with an exchange if there is
+    // nothing new to read, which is the common case.
+    if (next_read_index_.load(std::memory_order_relaxed) == kNullIndex) {
+      return false;
+    }
     Index next_read_index =
         next_read_index_.exchange(kNullIndex, std::memory_order_acq_rel);
     if (next_read_index != kNullIndex) {
@@ -104,8 +144,15 @@ class Local3StateRcu {
     }
   }
 
+  // Returns `true` if the in-flight instance is "U->R", that is, if
+  // `TryRead()` would advance the Reader. Unlike `TryRead()`, it can be called
+  // by any thread.
+  bool CanRead() const noexcept {
+    return next_read_index_.load(std::memory_order_acquire) != kNullIndex;
+  }
+
   // Reference to the value that can be manipulated by the updating thread.
-  T& Update() noexcept { return values_[update_.index]; }
+  T& Update() noexcept { return values_[update_.index].value; }
 
   // Advance the Updater to a new value, if possible.
   //
@@ -170,7 +217,7 @@ class Local3StateRcu {
   // without providing a new value by `ForceUpdate()` or `TryUpdate()`.
   T* ReclaimByUpdate() noexcept {
     if (next_read_index_.load(std::memory_order_acquire) == kNullIndex) {
-      return &values_[update_.OldReadIndex()];
+      return &values_[update_.OldReadIndex()].value;
     } else {
       return nullptr;
     }
@@ -179,12 +226,20 @@ class Local3StateRcu {
  private:
   using Index = int_fast8_t;
   static constexpr Index kNullIndex = -1;
+  static constexpr std::size_t kAlignment =
+      kAlignToCacheLines ? kCacheLineSize : 1;
+
+  // Holds a single instance of `T`, possibly aligned to a cache line.
+  // The strictest of the two alignment specifiers applies.
+  struct alignas(T) alignas(kAlignment) Slot {
+    T value;
+  };
 
   // Storage for instances of `T` that are juggled around between the reader
   // and updater threads.
   // All the variables below are indices into `values_`, that is, from set
   // {0, 1, 2}.
-  std::array<T, 3> values_;
+  std::array<Slot, 3> values_;
   // If `kNullIndex`, there is no new value available to the reader thread.
   // Invariants in this case:
   //  read_.index == update_.next_index != update_.index
@@ -193,14 +248,14 @@ class Local3StateRcu {
   // Invariants in this case:
   //  * {read_.index, update_.index, update_.next_index} = {0, 1, 2}
   //  * next_read_index_.load() == update_.next_index
-  std::atomic<Index> next_read_index_;
+  alignas(kAlignment) std::atomic<Index> next_read_index_;
   // Accessed only by the "read" thread:
-  struct {
+  struct alignas(kAlignment) {
     // The reader thread can manipulate the value at this index.
     Index index;
   } read_;
   // Accessed only by the "update" thread.
-  struct {
+  struct alignas(kAlignment) {
     // After `index` is pushed to `next_read_index_` above, rotate remaining
     // indices: next_index <- index <- old read index.
     inline void RotateAfterNext() noexcept {
@@ -221,6 +276,195 @@ class Local3StateRcu {
   } update_;
 };
 
+// `true` if `T` can be passed between the Reader and the Updater in a single
+// atomic word, so that `Local3StateRcu<T>` uses the specialization below.
+template <typename T>
+struct IsLocal3StateRcuWord
+    : std::integral_constant<bool, std::is_trivially_copyable<T>::value &&
+                                       (sizeof(T) <= sizeof(uint64_t))> {};
+
+// Specialization for small trivially copyable types, such as 64-bit counters
+// or pointers, with the same contract as above.
+//
+// The generic implementation passes only indices, so the Reader pays one
+// cache line transfer to learn that a new value is available and another one
+// to read it from its slot. Here the Updater copies the value itself into one
+// of two atomic words, alternating between them, and then publishes its
+// sequence number in a state word. The Reader claims the value by a
+// compare-and-swap of the state word, which fails if the Updater has replaced
+// the value in the meantime, and hands over its previous value in another
+// atomic word. A `uint64_t` sequence number never wraps around, so an
+// outdated claim never succeeds. All these words share a single cache line.
+//
+// The Reader and the Updater keep their instances in plain variables, as well
+// as the Updater's copy of the in-flight instance. `ReclaimByUpdate()` points
+// to this copy and modifications through it are passed on to `Update()` by a
+// subsequent `TryUpdate()` or `ForceUpdate()`, as in the generic
+// implementation.
+//
+// The only difference is that `TryRead()` is lock-free instead of wait-free:
+// it retries if a concurrent `ForceUpdate()` replaces the in-flight value.
+template <typename T, bool kAlignToCacheLines>
+class Local3StateRcu<
+    T, kAlignToCacheLines,
+    typename std::enable_if<IsLocal3StateRcuWord<T>::value>::type> {
+ public:
+  Local3StateRcu(T read, T update, T reclaim)
+      : shared_(),
+        read_{std::move(read)},
+        update_{std::move(update)},
+        in_flight_{std::move(reclaim)},
+        sequence_(0),
+        reclaimed_(true) {}
+  explicit Local3StateRcu(const T& value)
+      : Local3StateRcu(value, value, value) {}
+  Local3StateRcu() : Local3StateRcu(T(), T(), T()) {}
+  ~Local3StateRcu() noexcept = default;
+
+  T& Read() noexcept { return read_.value; }
+
+  bool TryRead() noexcept {
+    Word state = shared_.state.load(std::memory_order_acquire);
+    while (ToReader(state)) {
+      const Word value = shared_.to_reader[Sequence(state) & 1].load(
+          std::memory_order_relaxed);
+      shared_.to_updater.store(Pack(read_.value), std::memory_order_relaxed);
+      // Fails if the Updater has replaced `value` meanwhile, then retries
+      // with the replacement.
+      if (shared_.state.compare_exchange_weak(
+              state, state & ~kToReader,
+              /*success=*/std::memory_order_acq_rel,
+              /*failure=*/std::memory_order_acquire)) {
+        Unpack(value, read_.value);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool CanRead() const noexcept {
+    return ToReader(shared_.state.load(std::memory_order_acquire));
+  }
+
+  T& Update() noexcept { return update_.value; }
+
+  bool TryUpdate() noexcept {
+    // The Reader never modifies a "R->U" state.
+    if (ToReader(shared_.state.load(std::memory_order_acquire))) {
+      return false;
+    }
+    Publish();
+    return true;
+  }
+
+  bool ForceUpdate() noexcept {
+    Word state = shared_.state.load(std::memory_order_acquire);
+    if (ToReader(state)) {
+      const Word value = Pack(update_.value);
+      shared_.to_reader[(sequence_ + 1) & 1].store(value,
+                                                   std::memory_order_relaxed);
+      if (shared_.state.compare_exchange_strong(
+              state, State(sequence_ + 1, /*to_reader=*/true),
+              /*success=*/std::memory_order_acq_rel,
+              /*failure=*/std::memory_order_acquire)) {
+        // The replaced value has never been read.
+        sequence_++;
+        Unpack(Pack(in_flight_.value), update_.value);
+        Unpack(value, in_flight_.value);
+        return false;
+      }
+      // The Reader has claimed the in-flight value meanwhile.
+    }
+    Publish();
+    return true;
+  }
+
+  T* ReclaimByUpdate() noexcept {
+    if (ToReader(shared_.state.load(std::memory_order_acquire))) {
+      return nullptr;
+    }
+    if (!reclaimed_) {
+      Unpack(shared_.to_updater.load(std::memory_order_relaxed),
+             in_flight_.value);
+      reclaimed_ = true;
+    }
+    return &in_flight_.value;
+  }
+
+ private:
+  using Word = uint64_t;
+  static constexpr Word kToReader = 1;
+  static constexpr std::size_t kAlignment =
+      kAlignToCacheLines ? kCacheLineSize : 1;
+
+  struct alignas(T) alignas(kAlignment) Slot {
+    T value;
+  };
+
+  // The state word holds the sequence number of the last published value and
+  // whether the in-flight instance is "U->R".
+  static Word State(Word sequence, bool to_reader) noexcept {
+    return (sequence << 1) | (to_reader ? kToReader : 0);
+  }
+  static Word Sequence(Word state) noexcept { return state >> 1; }
+  static bool ToReader(Word state) noexcept {
+    return (state & kToReader) != 0;
+  }
+
+  static Word Pack(const T& value) noexcept {
+    Word word = 0;
+    std::memcpy(&word, &value, sizeof(T));
+    return word;
+  }
+  static void Unpack(Word word, T& value) noexcept {
+    std::memcpy(static_cast<void*>(&value), &word, sizeof(T));
+  }
+
+  // Publishes `Update()` in place of the "R->U" instance, which becomes the
+  // new `Update()`. The Reader doesn't modify the state words until the value
+  // is published.
+  void Publish() noexcept {
+    const Word value = Pack(update_.value);
+    sequence_++;
+    shared_.to_reader[sequence_ & 1].store(value, std::memory_order_relaxed);
+    if (reclaimed_) {
+      Unpack(Pack(in_flight_.value), update_.value);
+    } else {
+      Unpack(shared_.to_updater.load(std::memory_order_relaxed),
+             update_.value);
+    }
+    shared_.state.store(State(sequence_, /*to_reader=*/true),
+                        std::memory_order_release);
+    Unpack(value, in_flight_.value);
+    reclaimed_ = false;
+  }
+
+  // Accessed by both threads.
+  struct alignas(Word) alignas(kAlignment) Shared {
+    Shared()
+        : state(State(0, /*to_reader=*/false)), to_reader(), to_updater(0) {}
+
+    std::atomic<Word> state;
+    // The "U->R" value with an odd or even sequence number.
+    std::atomic<Word> to_reader[2];
+    // The "R->U" value, written by the Reader before claiming a "U->R" one.
+    std::atomic<Word> to_updater;
+  } shared_;
+  // Accessed only by the "read" thread.
+  Slot read_;
+  // Accessed only by the "update" thread.
+  Slot update_;
+  // The "update" thread's copy of the in-flight instance. If "U->R", the last
+  // published value, if "R->U" and `reclaimed_` is set, the value handed over
+  // by the Reader.
+  Slot in_flight_;
+  // The sequence number of the last published value.
+  Word sequence_;
+  // Whether `in_flight_` holds the "R->U" instance. Initially it's
+  // `reclaim`, so `shared_.to_updater` isn't read until the Reader writes it.
+  bool reclaimed_;
+};
+
 }  // namespace simple_rcu
 
 #endif  // _SIMPLE_RCU_LOCAL_3STATE_RCU_H
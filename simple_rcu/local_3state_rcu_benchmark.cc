@@ -0,0 +1,85 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// Larger than a word, so that it selects the generic implementation.
+struct Wide {
+  Wide& operator=(int_fast32_t value_) {
+    value = value_;
+    return *this;
+  }
+
+  int_fast32_t value;
+  int_fast32_t padding;
+};
+
+// Thread 0 is the Updater, thread 1 the Reader of a shared instance.
+template <typename T, bool kAlignToCacheLines>
+static void BM_PingPong(benchmark::State& state) {
+  static Local3StateRcu<T, kAlignToCacheLines> rcu;
+  if (state.thread_index() == 0) {
+    int_fast32_t updates = 0;
+    for (auto _ : state) {
+      rcu.Update() = ++updates;
+      benchmark::DoNotOptimize(rcu.ForceUpdate());
+    }
+  } else {
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(rcu.TryRead());
+      benchmark::DoNotOptimize(rcu.Read());
+    }
+  }
+}
+// Passes the value in atomic words, see `IsLocal3StateRcuWord`.
+BENCHMARK_TEMPLATE(BM_PingPong, int_fast32_t, false)->Threads(2);
+BENCHMARK_TEMPLATE(BM_PingPong, int_fast32_t, true)->Threads(2);
+BENCHMARK_TEMPLATE(BM_PingPong, Wide, false)->Threads(2);
+BENCHMARK_TEMPLATE(BM_PingPong, Wide, true)->Threads(2);
+
+// Like `BM_PingPong`, but neither side forces an exchange. Reports the number
+// of values actually passed from the Updater to the Reader as items.
+template <typename T>
+static void BM_TryPingPong(benchmark::State& state) {
+  static Local3StateRcu<T> rcu;
+  if (state.thread_index() == 0) {
+    int_fast32_t updates = 0;
+    int_fast32_t exchanges = 0;
+    for (auto _ : state) {
+      rcu.Update()[0] = ++updates;
+      exchanges += rcu.TryUpdate();
+    }
+    // Each exchange is counted once, by the updater. Items of all threads are
+    // summed up.
+    state.SetItemsProcessed(exchanges);
+  } else {
+    for (auto _ : state) {
+      rcu.TryRead();
+      benchmark::DoNotOptimize(rcu.Read()[0]);
+    }
+  }
+}
+BENCHMARK_TEMPLATE(BM_TryPingPong, std::array<int_fast32_t, 1>)->Threads(2);
+// A 4 KiB value.
+BENCHMARK_TEMPLATE(BM_TryPingPong, std::array<uint64_t, 512>)->Threads(2);
+
+}  // namespace
+}  // namespace simple_rcu
@@ -14,13 +14,51 @@
 
 #include "simple_rcu/local_3state_rcu.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
 #include "gtest/gtest.h"
 
 namespace simple_rcu {
 namespace {
 
-TEST(Local3StateRcuTest, ConstructorArgumentsAndInitialState) {
-  Local3StateRcu<int_fast32_t> rcu(42);
+// Not trivially copyable, so that it selects the generic implementation.
+struct Boxed {
+  Boxed(int value_ = 0) : value(value_) {}
+  Boxed(const Boxed& other) : value(other.value) {}
+  Boxed& operator=(const Boxed& other) {
+    value = other.value;
+    return *this;
+  }
+
+  bool operator==(int other) const { return value == other; }
+  bool operator!=(int other) const { return value != other; }
+
+  int value;
+};
+
+int ToInt(const Boxed& boxed) { return boxed.value; }
+template <typename T>
+int ToInt(T value) {
+  return static_cast<int>(value);
+}
+
+static_assert(!IsLocal3StateRcuWord<Boxed>::value,
+              "Boxed must use the generic implementation");
+static_assert(IsLocal3StateRcuWord<int32_t>::value &&
+                  IsLocal3StateRcuWord<int64_t>::value &&
+                  IsLocal3StateRcuWord<const char*>::value,
+              "Words must use the specialization");
+
+template <typename T>
+class Local3StateRcuTest : public ::testing::Test {};
+
+using Types = ::testing::Types<Boxed, int32_t, int64_t>;
+TYPED_TEST_SUITE(Local3StateRcuTest, Types);
+
+TYPED_TEST(Local3StateRcuTest, ConstructorArgumentsAndInitialState) {
+  Local3StateRcu<TypeParam> rcu(42);
   EXPECT_EQ(rcu.Read(), 42);
   EXPECT_EQ(rcu.Update(), 42);
   EXPECT_FALSE(rcu.TryRead()) << "Read shouldn't advance in an initial state";
@@ -28,8 +66,8 @@ TEST(Local3StateRcuTest, ConstructorArgumentsAndInitialState) {
   EXPECT_EQ(rcu.Update(), 42);
 }
 
-TEST(Local3StateRcuTest, UpdateAndReadReferences) {
-  Local3StateRcu<int> rcu(0);
+TYPED_TEST(Local3StateRcuTest, UpdateAndReadReferences) {
+  Local3StateRcu<TypeParam> rcu(0);
   // Set up a new value in `Update()`.
   EXPECT_NE(&rcu.Update(), &rcu.Read())
       << "Update and Read must never point to the same object";
@@ -63,14 +101,14 @@ TEST(Local3StateRcuTest, UpdateAndReadReferences) {
       << "Read and ReclaimByUpdate() must never point to the same object";
 }
 
-TEST(Local3StateRcuTest, ReclaimedToUpdate) {
-  Local3StateRcu<int> rcu(/*read=*/0, /*update=*/0, /*reclaim=*/42);
+TYPED_TEST(Local3StateRcuTest, ReclaimedToUpdate) {
+  Local3StateRcu<TypeParam> rcu(/*read=*/0, /*update=*/0, /*reclaim=*/42);
   ASSERT_NE(rcu.ReclaimByUpdate(), nullptr);
   EXPECT_EQ(*rcu.ReclaimByUpdate(), 42);
 }
 
-TEST(Local3StateRcuTest, DoubleUpdateBetweenReads) {
-  Local3StateRcu<int> rcu(0);
+TYPED_TEST(Local3StateRcuTest, DoubleUpdateBetweenReads) {
+  Local3StateRcu<TypeParam> rcu(0);
   // Set up a new value in `Update()`.
   rcu.Update() = 42;
   EXPECT_TRUE(rcu.ForceUpdate()) << "Update should advance";
@@ -84,8 +122,8 @@ TEST(Local3StateRcuTest, DoubleUpdateBetweenReads) {
   EXPECT_EQ(rcu.Read(), 73);
 }
 
-TEST(Local3StateRcuTest, DoubleTryUpdateBetweenReads) {
-  Local3StateRcu<int> rcu;
+TYPED_TEST(Local3StateRcuTest, DoubleTryUpdateBetweenReads) {
+  Local3StateRcu<TypeParam> rcu;
   EXPECT_EQ(rcu.Read(), 0);
   EXPECT_EQ(rcu.Update(), 0);
   // Set up a new value in `Update()`.
@@ -103,8 +141,8 @@ TEST(Local3StateRcuTest, DoubleTryUpdateBetweenReads) {
   EXPECT_EQ(rcu.Read(), 42);
 }
 
-TEST(Local3StateRcuTest, AlternatingUpdatesAndReads) {
-  Local3StateRcu<int> rcu(/*read=*/0, /*update=*/-42, /*reclaim=*/1);
+TYPED_TEST(Local3StateRcuTest, AlternatingUpdatesAndReads) {
+  Local3StateRcu<TypeParam> rcu(/*read=*/0, /*update=*/-42, /*reclaim=*/1);
   for (int i = 1; i <= 10; i++) {
     SCOPED_TRACE(i);
     rcu.Update() = -1;  // Value that we'll overwrite later.
@@ -124,8 +162,8 @@ TEST(Local3StateRcuTest, AlternatingUpdatesAndReads) {
   }
 }
 
-TEST(Local3StateRcuTest, AlternatingTryUpdatesAndReads) {
-  Local3StateRcu<int> rcu(/*read=*/0, /*update=*/-42, /*reclaim=*/1);
+TYPED_TEST(Local3StateRcuTest, AlternatingTryUpdatesAndReads) {
+  Local3StateRcu<TypeParam> rcu(/*read=*/0, /*update=*/-42, /*reclaim=*/1);
   for (int i = 1; i <= 10; i++) {
     SCOPED_TRACE(i);
     rcu.Update() = i;
@@ -145,5 +183,40 @@ TEST(Local3StateRcuTest, AlternatingTryUpdatesAndReads) {
   }
 }
 
+TYPED_TEST(Local3StateRcuTest, AlignedToCacheLines) {
+  Local3StateRcu<TypeParam, /*kAlignToCacheLines=*/true> rcu(0);
+  EXPECT_GE(alignof(decltype(rcu)), kCacheLineSize);
+  EXPECT_GE(reinterpret_cast<char*>(rcu.ReclaimByUpdate()) -
+                reinterpret_cast<char*>(&rcu.Update()),
+            static_cast<std::ptrdiff_t>(kCacheLineSize))
+      << "Instances of T must be on separate cache lines";
+  rcu.Update() = 42;
+  EXPECT_TRUE(rcu.ForceUpdate());
+  EXPECT_TRUE(rcu.TryRead());
+  EXPECT_EQ(rcu.Read(), 42);
+}
+
+TYPED_TEST(Local3StateRcuTest, ConcurrentForceUpdatesAndReads) {
+  static constexpr int kUpdates = 100000;
+  Local3StateRcu<TypeParam> rcu(0);
+  std::thread updater([&rcu]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      rcu.Update() = i;
+      rcu.ForceUpdate();
+    }
+  });
+  bool ordered = true;
+  int last = 0;
+  while (last < kUpdates) {
+    if (rcu.TryRead()) {
+      const int read = ToInt(rcu.Read());
+      ordered &= read > last;
+      last = read;
+    }
+  }
+  updater.join();
+  EXPECT_TRUE(ordered) << "Values must be read in order, each at most once";
+}
+
 }  // namespace
 }  // namespace simple_rcu
@@ -0,0 +1,147 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_LOCAL_BROADCAST_RCU_H
+#define _SIMPLE_RCU_LOCAL_BROADCAST_RCU_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// Variant of `Local3StateRcu` for a single Updater and a fixed number of
+// Readers, which share a pool of `readers + 2` instances of `T`, instead of
+// needing 3 for each Reader.
+//
+// - Each Reader uses one instance via `Read(reader)`, and announces which one
+//   it is.
+// - The latest published instance is available to all Readers.
+// - The Updater fills a spare instance available via `Update()`, which isn't
+//   used by anybody else, and publishes it by `ForceUpdate()`.
+//
+// Since the Readers and the latest instance use at most `readers + 1`
+// instances, a spare one always exists. Therefore a value is written just once
+// for all Readers, and never copied.
+//
+// Readers are identified by indices from 0 to `readers - 1`. No two
+// `...Read...` methods with the same `reader` may be called concurrently, and
+// no two `...Update...` methods. Readers only get a `const` reference, since
+// the instance is shared with other Readers.
+//
+// The implementation uses only atomic operations and does no memory
+// allocations after construction. `ForceUpdate()` is O(readers), `TryRead()`
+// is O(1), but not wait-free: it retries if the Updater publishes a new value
+// concurrently.
+template <typename T>
+class LocalBroadcastRcu {
+ public:
+  // Builds an instance for `readers` Readers with all instances of `T`
+  // initialized to `value`. All Readers start with the same instance and
+  // `TryRead()` returns `false` until `ForceUpdate()` is called.
+  explicit LocalBroadcastRcu(size_t readers, const T& value = T())
+      : values_(readers + 2, value),
+        latest_(0),
+        announced_(readers),
+        update_index_(1),
+        in_use_(readers + 2, false) {
+    for (Announced& announced : announced_) {
+      announced.index.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  size_t readers() const noexcept { return announced_.size(); }
+
+  // Reference to the value that can be read by the reading thread `reader`.
+  const T& Read(size_t reader) const noexcept {
+    return values_[announced_[reader].index.load(std::memory_order_relaxed)];
+  }
+
+  // Advances the Reader `reader` to the latest published value, if it doesn't
+  // use it already. Returns `true` if so. In this case the previous reference
+  // returned by `Read(reader)` must be considered invalid and must not be used
+  // any more.
+  bool TryRead(size_t reader) noexcept {
+    std::atomic<Index>& announced = announced_[reader].index;
+    const Index current = announced.load(std::memory_order_relaxed);
+    Index latest = latest_.load(std::memory_order_acquire);
+    if (latest == current) {
+      return false;
+    }
+    while (true) {
+      // Sequentially consistent, so that the Updater either sees the
+      // announcement and leaves the instance alone, or has published a newer
+      // value before it and the check below fails.
+      announced.store(latest, std::memory_order_seq_cst);
+      const Index validated = latest_.load(std::memory_order_seq_cst);
+      if (validated == latest) {
+        return true;
+      }
+      latest = validated;
+    }
+  }
+
+  // Reference to the spare value that can be manipulated by the updating
+  // thread. Note that it holds some older value, not necessarily the latest
+  // published one.
+  T& Update() noexcept { return values_[update_index_]; }
+
+  // Publishes the value stored in `Update()` to all Readers and makes another
+  // spare value available in `Update()`. The previous reference returned by
+  // `Update()` must be considered invalid and must not be used any more.
+  void ForceUpdate() noexcept {
+    const Index published = update_index_;
+    latest_.store(published, std::memory_order_seq_cst);
+    for (Announced& announced : announced_) {
+      in_use_[announced.index.load(std::memory_order_seq_cst)] = true;
+    }
+    in_use_[published] = true;
+    for (size_t i = 0; i < in_use_.size(); i++) {
+      if (!in_use_[i]) {
+        update_index_ = static_cast<Index>(i);
+      }
+      in_use_[i] = false;
+    }
+  }
+
+ private:
+  using Index = uint32_t;
+
+  // Aligned, so that announcements of different Readers don't share a cache
+  // line. Before C++17 `std::vector` doesn't respect such alignment, but
+  // since its size is a whole cache line, no two announcements share one
+  // anyway.
+  struct alignas(kCacheLineSize) Announced {
+    std::atomic<Index> index;
+  };
+  static_assert(sizeof(Announced) == kCacheLineSize,
+                "Announced must occupy exactly one cache line");
+
+  std::vector<T> values_;
+  // The index of the latest published value.
+  std::atomic<Index> latest_;
+  // The index of the value used by each Reader.
+  std::vector<Announced> announced_;
+  // Accessed only by the Updater:
+  Index update_index_;
+  // Scratch space for `ForceUpdate()` to avoid allocations.
+  std::vector<bool> in_use_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_LOCAL_BROADCAST_RCU_H
@@ -0,0 +1,87 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/local_broadcast_rcu.h"
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(LocalBroadcastRcuTest, InitialState) {
+  LocalBroadcastRcu<int> rcu(2, 42);
+  EXPECT_EQ(rcu.readers(), 2);
+  EXPECT_EQ(rcu.Read(0), 42);
+  EXPECT_EQ(rcu.Read(1), 42);
+  EXPECT_FALSE(rcu.TryRead(0));
+  EXPECT_FALSE(rcu.TryRead(1));
+}
+
+TEST(LocalBroadcastRcuTest, UpdateAndRead) {
+  LocalBroadcastRcu<int> rcu(3);
+  for (int i = 1; i <= 10; i++) {
+    rcu.Update() = i;
+    rcu.ForceUpdate();
+    // Only some of the readers advance, so that they use different values.
+    for (size_t reader = 0; reader < rcu.readers(); reader++) {
+      if (i % (reader + 1) == 0) {
+        EXPECT_TRUE(rcu.TryRead(reader));
+        EXPECT_EQ(rcu.Read(reader), i);
+        EXPECT_FALSE(rcu.TryRead(reader));
+      }
+    }
+  }
+  EXPECT_EQ(rcu.Read(0), 10);
+  EXPECT_EQ(rcu.Read(1), 10);
+  EXPECT_EQ(rcu.Read(2), 9) << "Reader 2 must keep its older value";
+}
+
+TEST(LocalBroadcastRcuTest, ConcurrentUpdatesAndReads) {
+  static constexpr int kReaders = 4;
+  static constexpr int kUpdates = 100000;
+  using Value = std::array<int, 16>;
+  LocalBroadcastRcu<Value> rcu(kReaders, Value{});
+  std::atomic<bool> finished(false);
+  std::vector<std::thread> readers;
+  for (int reader = 0; reader < kReaders; reader++) {
+    readers.emplace_back([&, reader]() {
+      int previous = 0;
+      while (!finished.load()) {
+        rcu.TryRead(reader);
+        const Value& value = rcu.Read(reader);
+        for (int element : value) {
+          ASSERT_EQ(element, value[0]) << "Value must not change while read";
+        }
+        ASSERT_GE(value[0], previous) << "Values must be read in order";
+        previous = value[0];
+      }
+    });
+  }
+  for (int i = 1; i <= kUpdates; i++) {
+    rcu.Update().fill(i);
+    rcu.ForceUpdate();
+  }
+  finished.store(true);
+  for (auto& thread : readers) {
+    thread.join();
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu
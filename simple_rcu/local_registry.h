@@ -0,0 +1,365 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_LOCAL_REGISTRY_H
+#define _SIMPLE_RCU_LOCAL_REGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace simple_rcu {
+
+// Registry of per-thread values shared between their threads and a single
+// thread iterating over them, such as an updater of `Rcu` or a collector of
+// `ReverseRcu`.
+//
+// The registry owns a pool of nodes holding the values, allocated in slabs of
+// `kSlabSize` contiguous nodes, so that iterating over them is cache friendly:
+//
+// - `Add` constructs a value in a free node, reusing nodes of removed values
+//   first. Only if all nodes are in use it allocates a new slab. It's
+//   lock-free. Counters of free nodes let it skip slabs without any, and fresh
+//   nodes are taken only from the newest slab, so that it's O(1) unless there
+//   are nodes to reuse.
+// - `Remove` only marks a node as dead, which is wait-free. After that the
+//   node must not be accessed by its thread any more.
+// - `ForEach` iterates over the nodes. It destroys values in dead nodes and
+//   makes the nodes free for reuse.
+//
+// Therefore registering and unregistering threads never waits for `ForEach`,
+// and `ForEach` can safely access all nodes it visits, even if they're
+// being concurrently removed.
+//
+// By default a node is reused only after `ForEach` has passed its value to
+// `dead`, so the number of nodes grows with the number of values removed
+// between calls to `ForEach`. Callers that don't need `dead` to observe every
+// removed value can set `kReclaimDead`. Then `Add` also reuses dead nodes
+// directly, destroying their values itself, unless a `ForEach` is running at
+// the same time. The number of nodes is then bounded by the peak number of
+// values, plus the ones removed during a single `ForEach` or concurrently with
+// `Add`, rounded up to whole slabs, even if `ForEach` is never called.
+template <typename T, bool kReclaimDead = false>
+class LocalRegistry final {
+ private:
+  struct Slab;
+
+ public:
+  static constexpr size_t kSlabSize = 16;
+
+  class Node final {
+   public:
+    T& value() noexcept { return *reinterpret_cast<T*>(&storage_); }
+
+   private:
+    enum State : uint_fast8_t {
+      // Never used, can be taken only by incrementing `Slab::size`.
+      kFresh,
+      // Freed by `ForEach`, can be reused.
+      kFree,
+      // Claimed by `Add`, which is constructing the value, or by an `Add` or
+      // `ForEach` destroying a dead value if `kReclaimDead` is set.
+      kClaimed,
+      kLive,
+      kDead,
+    };
+
+    Node() : storage_(), state_(kFresh), slab_(nullptr) {}
+
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+    std::atomic<State> state_;
+    // The slab containing the node, for updating its counters in `Remove`.
+    Slab* slab_;
+
+    friend class LocalRegistry;
+  };
+
+  LocalRegistry() : head_(nullptr), free_(0), iterating_(false) {}
+  LocalRegistry(const LocalRegistry&) = delete;
+  LocalRegistry& operator=(const LocalRegistry&) = delete;
+  // Destroys all values, regardless if dead or not.
+  ~LocalRegistry() {
+    Slab* slab = head_.load(std::memory_order_acquire);
+    while (slab != nullptr) {
+      for (size_t i = 0; i < slab->used(); i++) {
+        Node& node = slab->nodes[i];
+        typename Node::State state = node.state_.load(std::memory_order_acquire);
+        if (state == Node::kLive || state == Node::kDead) {
+          node.value().~T();
+        }
+      }
+      Slab* next = slab->next;
+      DeleteSlab(slab);
+      slab = next;
+    }
+  }
+
+  // Constructs a new value from `args` in a free node and adds it to the
+  // registry.
+  // Lock-free and thread-safe.
+  template <typename... Args>
+  Node* Add(Args&&... args) {
+    Node* node = Claim();
+    new (&node->storage_) T(std::forward<Args>(args)...);
+    // Sequentially consistent, so that a subsequent sequentially consistent
+    // store by the node's thread can't be observed by a `ForEach` that doesn't
+    // visit the node.
+    node->state_.store(Node::kLive, std::memory_order_seq_cst);
+    return node;
+  }
+
+  // Marks `node` as dead. Its value is then destroyed by the next call to
+  // `ForEach`, or if `kReclaimDead` is set, possibly by `Add` reusing the node.
+  // Wait-free and thread-safe.
+  static void Remove(Node* node) noexcept {
+    Slab* const slab = node->slab_;
+    node->state_.store(Node::kDead, std::memory_order_release);
+    if (kReclaimDead) {
+      slab->free.fetch_add(1, std::memory_order_relaxed);
+      slab->registry->free_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Calls `live(T&)` for each node that hasn't been removed yet.
+  // For nodes that have been removed, calls `dead(T&)` and destroys their
+  // values. A node that is being concurrently removed is passed to either
+  // `live` or `dead`. Nodes that are being concurrently added might be
+  // skipped. If `kReclaimDead` is set, nodes already reused by `Add` aren't
+  // passed to `dead`.
+  //
+  // Concurrent calls must be serialized by the caller, but it's thread-safe
+  // with respect to `Add` and `Remove`.
+  template <typename L, typename D>
+  void ForEach(L&& live, D&& dead) {
+    Cursor cursor;
+    ForEachChunk(cursor, SIZE_MAX, std::forward<L>(live),
+                 std::forward<D>(dead));
+  }
+
+  // Position of an iteration over the registry in chunks by `ForEachChunk`.
+  // Starts at the first node. Remains valid for the lifetime of the registry.
+  class Cursor final {
+   public:
+    Cursor() : slab_(nullptr), started_(false) {}
+
+    // Whether the iteration has started.
+    bool started() const noexcept { return started_; }
+    // Whether all nodes have been visited.
+    bool done() const noexcept { return started_ && slab_ == nullptr; }
+
+   private:
+    // The next slab to visit.
+    Slab* slab_;
+    bool started_;
+
+    friend class LocalRegistry;
+  };
+
+  // Like `ForEach`, but visits only the nodes of at most `slabs` slabs
+  // starting at `cursor`, and advances `cursor` past them. This allows
+  // callers to release their lock between chunks. Each call must be
+  // serialized with other calls of `ForEach` and `ForEachChunk`, but
+  // iterations with different cursors can be interleaved. Nodes added after
+  // the first call for `cursor` might be skipped.
+  template <typename L, typename D>
+  void ForEachChunk(Cursor& cursor, size_t slabs, L&& live, D&& dead) {
+    if (kReclaimDead) {
+      // Sequentially consistent, pairs with `TryReclaim`: Either it observes
+      // the flag, or this observes the node it has claimed.
+      iterating_.store(true, std::memory_order_seq_cst);
+    }
+    if (!cursor.started_) {
+      cursor.slab_ = head_.load(std::memory_order_seq_cst);
+      cursor.started_ = true;
+    }
+    for (; cursor.slab_ != nullptr && slabs > 0;
+         cursor.slab_ = cursor.slab_->next, slabs--) {
+      Slab* slab = cursor.slab_;
+      // Nodes taken from the slab after this point are skipped.
+      const size_t used = slab->used();
+      for (size_t i = 0; i < used; i++) {
+        Node& node = slab->nodes[i];
+        switch (node.state_.load(std::memory_order_seq_cst)) {
+          case Node::kLive:
+            live(node.value());
+            break;
+          case Node::kDead: {
+            typename Node::State expected = Node::kDead;
+            if (kReclaimDead && !node.state_.compare_exchange_strong(
+                                    expected, Node::kClaimed,
+                                    std::memory_order_acquire,
+                                    std::memory_order_relaxed)) {
+              // Being reclaimed by `Add`.
+              break;
+            }
+            dead(node.value());
+            node.value().~T();
+            node.state_.store(Node::kFree, std::memory_order_release);
+            if (!kReclaimDead) {
+              // Otherwise already counted by `Remove`.
+              slab->free.fetch_add(1, std::memory_order_relaxed);
+              free_.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+          }
+          default:
+            break;
+        }
+      }
+    }
+    if (kReclaimDead) {
+      iterating_.store(false, std::memory_order_release);
+    }
+  }
+
+ private:
+  struct Slab {
+    Slab(LocalRegistry* registry_, void* allocation_)
+        : nodes(),
+          size(0),
+          free(0),
+          next(nullptr),
+          registry(registry_),
+          allocation(allocation_) {
+      for (Node& node : nodes) {
+        node.slab_ = this;
+      }
+    }
+
+    // The number of nodes that have ever been taken from the slab.
+    size_t used() const noexcept {
+      return std::min(size.load(std::memory_order_seq_cst), kSlabSize);
+    }
+
+    Node nodes[kSlabSize];
+    // Incremented when taking a fresh node, can grow over `kSlabSize`.
+    std::atomic<size_t> size;
+    // The number of nodes in state `kFree`, and also `kDead` if `kReclaimDead`
+    // is set. Only a hint for `Claim`, it can be temporarily negative, as a
+    // node can be claimed before the increment.
+    std::atomic<ptrdiff_t> free;
+    // Written before the slab is published, immutable afterwards.
+    Slab* next;
+    LocalRegistry* const registry;
+    // The memory allocated by `NewSlab`.
+    void* const allocation;
+  };
+
+  // Returns a node in state `kClaimed`.
+  Node* Claim() {
+    while (true) {
+      Slab* head = head_.load(std::memory_order_acquire);
+      // Reuse a free node first, to keep the nodes in use compact.
+      if (free_.load(std::memory_order_relaxed) > 0) {
+        for (Slab* slab = head; slab != nullptr; slab = slab->next) {
+          if (slab->free.load(std::memory_order_relaxed) <= 0) {
+            continue;
+          }
+          for (size_t i = 0; i < slab->used(); i++) {
+            if (TryClaim(slab->nodes[i]) ||
+                (kReclaimDead && TryReclaim(slab->nodes[i]))) {
+              slab->free.fetch_sub(1, std::memory_order_relaxed);
+              free_.fetch_sub(1, std::memory_order_relaxed);
+              return &slab->nodes[i];
+            }
+          }
+        }
+      }
+      // Take a fresh node. Only the newest slab can have any, see below.
+      if (head != nullptr &&
+          head->size.load(std::memory_order_relaxed) < kSlabSize) {
+        const size_t i = head->size.fetch_add(1);
+        if (i < kSlabSize) {
+          head->nodes[i].state_.store(Node::kClaimed,
+                                      std::memory_order_relaxed);
+          return &head->nodes[i];
+        }
+      }
+      // All slabs are full.
+      Slab* slab = NewSlab();
+      slab->size.store(1, std::memory_order_relaxed);
+      slab->nodes[0].state_.store(Node::kClaimed, std::memory_order_relaxed);
+      slab->next = head;
+      if (head_.compare_exchange_strong(slab->next, slab,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        return &slab->nodes[0];
+      }
+      // Another `Add` has published a slab in the meantime. Retry with it
+      // instead of leaving its fresh nodes behind the new one.
+      DeleteSlab(slab);
+    }
+  }
+
+  // Allocates a slab aligned to `alignof(Slab)`. Before C++17 `new` doesn't
+  // respect extended alignment, such as of values aligned to cache lines.
+  Slab* NewSlab() {
+    size_t space = sizeof(Slab) + alignof(Slab) - 1;
+    void* allocation = ::operator new(space);
+    void* aligned = allocation;
+    std::align(alignof(Slab), sizeof(Slab), aligned, space);
+    return new (aligned) Slab(this, allocation);
+  }
+
+  static void DeleteSlab(Slab* slab) noexcept {
+    void* allocation = slab->allocation;
+    slab->~Slab();
+    ::operator delete(allocation);
+  }
+
+  static bool TryClaim(Node& node) noexcept {
+    typename Node::State expected = Node::kFree;
+    return node.state_.load(std::memory_order_relaxed) == Node::kFree &&
+           node.state_.compare_exchange_strong(expected, Node::kClaimed,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed);
+  }
+
+  // Claims a dead node and destroys its value, unless `ForEach` is running
+  // and might be visiting it.
+  bool TryReclaim(Node& node) noexcept {
+    typename Node::State expected = Node::kDead;
+    if (node.state_.load(std::memory_order_relaxed) != Node::kDead ||
+        !node.state_.compare_exchange_strong(expected, Node::kClaimed,
+                                             std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+      return false;
+    }
+    if (iterating_.load(std::memory_order_seq_cst)) {
+      // Leave the node to `ForEach` or to a later `Add`.
+      node.state_.store(Node::kDead, std::memory_order_release);
+      return false;
+    }
+    node.value().~T();
+    return true;
+  }
+
+  std::atomic<Slab*> head_;
+  // The total number of reusable nodes, a hint like `Slab::free`.
+  std::atomic<ptrdiff_t> free_;
+  // Set while `ForEachChunk` runs, if `kReclaimDead` is set.
+  std::atomic<bool> iterating_;
+};
+
+template <typename T, bool kReclaimDead>
+constexpr size_t LocalRegistry<T, kReclaimDead>::kSlabSize;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_LOCAL_REGISTRY_H
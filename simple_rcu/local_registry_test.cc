@@ -0,0 +1,207 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/local_registry.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAre;
+
+struct Visited {
+  std::vector<int> live;
+  std::vector<int> dead;
+};
+
+Visited ForEach(LocalRegistry<int>& registry) {
+  Visited visited;
+  registry.ForEach([&visited](int value) { visited.live.push_back(value); },
+                   [&visited](int value) { visited.dead.push_back(value); });
+  return visited;
+}
+
+TEST(LocalRegistryTest, AddAndRemove) {
+  LocalRegistry<int> registry;
+  LocalRegistry<int>::Node* node1 = registry.Add(1);
+  registry.Add(2);
+  LocalRegistry<int>::Node* node3 = registry.Add(3);
+  EXPECT_EQ(node1->value(), 1);
+  Visited visited = ForEach(registry);
+  EXPECT_THAT(visited.live, UnorderedElementsAre(1, 2, 3));
+  EXPECT_THAT(visited.dead, IsEmpty());
+  LocalRegistry<int>::Remove(node1);
+  LocalRegistry<int>::Remove(node3);
+  visited = ForEach(registry);
+  EXPECT_THAT(visited.live, UnorderedElementsAre(2));
+  EXPECT_THAT(visited.dead, UnorderedElementsAre(1, 3));
+  visited = ForEach(registry);
+  EXPECT_THAT(visited.live, UnorderedElementsAre(2));
+  EXPECT_THAT(visited.dead, IsEmpty()) << "Dead nodes must be visited once";
+}
+
+TEST(LocalRegistryTest, AddWhileRemovingHead) {
+  LocalRegistry<int> registry;
+  LocalRegistry<int>::Node* node1 = registry.Add(1);
+  LocalRegistry<int>::Node* node2 = registry.Add(2);
+  LocalRegistry<int>::Remove(node1);
+  LocalRegistry<int>::Remove(node2);
+  Visited visited;
+  registry.ForEach([&visited](int value) { visited.live.push_back(value); },
+                   [&](int value) {
+                     visited.dead.push_back(value);
+                     // Adds a node in front of the next dead one.
+                     registry.Add(value + 10);
+                   });
+  EXPECT_THAT(visited.live, IsEmpty());
+  EXPECT_THAT(visited.dead, UnorderedElementsAre(1, 2));
+  visited = ForEach(registry);
+  EXPECT_THAT(visited.live, UnorderedElementsAre(11, 12))
+      << "Nodes added concurrently must be preserved";
+  EXPECT_THAT(visited.dead, IsEmpty());
+}
+
+TEST(LocalRegistryTest, ReusesNodesInSlabs) {
+  LocalRegistry<int> registry;
+  std::vector<LocalRegistry<int>::Node*> nodes;
+  for (size_t i = 0; i <= LocalRegistry<int>::kSlabSize; i++) {
+    nodes.push_back(registry.Add(static_cast<int>(i)));
+  }
+  EXPECT_EQ(nodes[LocalRegistry<int>::kSlabSize - 1] - nodes[0],
+            static_cast<std::ptrdiff_t>(LocalRegistry<int>::kSlabSize - 1))
+      << "Nodes of a slab must be contiguous";
+  LocalRegistry<int>::Remove(nodes[3]);
+  EXPECT_NE(registry.Add(-1), nodes[3])
+      << "A dead node mustn't be reused before it's been visited";
+  ForEach(registry);
+  EXPECT_EQ(registry.Add(-2), nodes[3]) << "Free nodes must be reused";
+  EXPECT_EQ(nodes[3]->value(), -2);
+}
+
+TEST(LocalRegistryTest, ReclaimsDeadNodesWithoutForEach) {
+  LocalRegistry<int, /*kReclaimDead=*/true> registry;
+  LocalRegistry<int, true>::Node* live = registry.Add(0);
+  LocalRegistry<int, true>::Node* node = registry.Add(1);
+  for (int i = 2; i < 100; i++) {
+    LocalRegistry<int, true>::Remove(node);
+    LocalRegistry<int, true>::Node* added = registry.Add(i);
+    ASSERT_EQ(added, node) << "A dead node must be reused directly";
+    EXPECT_EQ(added->value(), i);
+  }
+  registry.ForEach(
+      [&](int value) {
+        if (value == 0) {
+          // Removes the node being visited.
+          LocalRegistry<int, true>::Remove(live);
+          EXPECT_NE(registry.Add(-1), live)
+              << "A dead node mustn't be reused during ForEach";
+        }
+      },
+      [](int) {});
+  Visited visited;
+  registry.ForEach([&visited](int value) { visited.live.push_back(value); },
+                   [&visited](int value) { visited.dead.push_back(value); });
+  EXPECT_THAT(visited.live, UnorderedElementsAre(99, -1));
+  EXPECT_THAT(visited.dead, UnorderedElementsAre(0));
+}
+
+TEST(LocalRegistryTest, ConcurrentAddAndRemoveReclaimsDeadNodes) {
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 1000;
+  struct Counted {
+    Counted(std::atomic<int>& instances_) : instances(instances_) {
+      instances++;
+    }
+    ~Counted() { instances--; }
+
+    std::atomic<int>& instances;
+  };
+  std::atomic<int> instances(0);
+  std::atomic<int> peak(0);
+  {
+    LocalRegistry<Counted, /*kReclaimDead=*/true> registry;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; i++) {
+      threads.emplace_back([&]() {
+        for (int j = 0; j < kIterations; j++) {
+          LocalRegistry<Counted, true>::Remove(registry.Add(instances));
+          int observed = instances.load();
+          int expected = peak.load();
+          while (observed > expected &&
+                 !peak.compare_exchange_weak(expected, observed)) {
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  EXPECT_EQ(instances.load(), 0);
+  // Allows for a slab allocated by a racing `Add`.
+  EXPECT_LE(peak.load(),
+            static_cast<int>(2 * LocalRegistry<Counted, true>::kSlabSize))
+      << "Without ForEach the number of values must stay bounded";
+}
+
+TEST(LocalRegistryTest, AlignsValues) {
+  struct alignas(64) Aligned {
+    char value;
+  };
+  LocalRegistry<Aligned> registry;
+  for (size_t i = 0; i < 3 * LocalRegistry<Aligned>::kSlabSize; i++) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&registry.Add()->value()) %
+                  alignof(Aligned),
+              0)
+        << "Node " << i;
+  }
+}
+
+TEST(LocalRegistryTest, ConcurrentAddAndRemove) {
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 1000;
+  LocalRegistry<int> registry;
+  std::atomic<int> finished(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kIterations; j++) {
+        LocalRegistry<int>::Remove(registry.Add(j));
+      }
+      finished++;
+    });
+  }
+  int dead = 0;
+  while (finished.load() < kThreads) {
+    registry.ForEach([](int) {}, [&dead](int) { dead++; });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  registry.ForEach([](int) {}, [&dead](int) { dead++; });
+  EXPECT_EQ(dead, kThreads * kIterations)
+      << "Each removed node must be visited exactly once";
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,208 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_METRICS_H
+#define _SIMPLE_RCU_METRICS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+
+// Basic metric types built on top of `ReverseRcu`.
+//
+// Each metric is shared by all threads, while every writer thread constructs
+// its own `Local` instance of it. Writes into a `Local` only touch a value
+// owned by the current thread, and therefore don't contend with writes from
+// other threads. A scraper thread calls `Collect()` to combine the values
+// from all the `Local` instances.
+//
+// As with `ReverseRcu`, a live `Local` hands its value over to `Collect()`
+// only at the end of a write. Therefore if a thread writes multiple times
+// between two `Collect()` calls, the later writes are only collected after
+// its next write (or its `Local` destruction) following the `Collect()`.
+
+// Monotonically increasing counter.
+class Counter final {
+ public:
+  // Interface to the counter local to a particular writer thread.
+  // Construction and destruction are thread-safe operations, but the
+  // `Increment()` method is only thread-compatible.
+  class Local final {
+   public:
+    explicit Local(Counter& counter) : local_(counter.rcu_) {}
+
+    void Increment(uint64_t delta = 1) noexcept { local_.Add(delta); }
+
+   private:
+    ReverseRcu<uint64_t>::Local local_;
+  };
+
+  Counter() : rcu_(), lock_(), total_(0) {}
+
+  // Returns the sum of all increments from all `Local` instances, including
+  // ones that have been destroyed, since the construction of the counter.
+  //
+  // Thread-safe.
+  uint64_t Collect() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    total_ += rcu_.Collect();
+    return total_;
+  }
+
+ private:
+  ReverseRcu<uint64_t> rcu_;
+  absl::Mutex lock_;
+  uint64_t total_ GUARDED_BY(lock_);
+};
+
+// Value that can be both increased and decreased, such as the number of
+// requests currently in flight.
+class Gauge final {
+ public:
+  // Interface to the gauge local to a particular writer thread.
+  // Construction and destruction are thread-safe operations, but the `Add()`
+  // and `Subtract()` methods are only thread-compatible.
+  class Local final {
+   public:
+    explicit Local(Gauge& gauge) : local_(gauge.rcu_) {}
+
+    void Add(double delta) noexcept { local_.Add(delta); }
+    void Subtract(double delta) noexcept { local_.Add(-delta); }
+
+   private:
+    ReverseRcu<double>::Local local_;
+  };
+
+  Gauge() : rcu_(), lock_(), total_(0) {}
+
+  // Returns the sum of all changes from all `Local` instances, including ones
+  // that have been destroyed, since the construction of the gauge.
+  //
+  // Thread-safe.
+  double Collect() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    total_ += rcu_.Collect();
+    return total_;
+  }
+
+ private:
+  ReverseRcu<double> rcu_;
+  absl::Mutex lock_;
+  double total_ GUARDED_BY(lock_);
+};
+
+// Distribution of values into a fixed set of buckets.
+class Histogram final {
+ public:
+  // Counts of recorded values. Satisfies the `ReverseRcu` requirements.
+  struct Buckets {
+    Buckets() : counts(), count(0), sum(0) {}
+
+    Buckets& operator+=(Buckets&& other) {
+      if (counts.size() < other.counts.size()) {
+        counts.resize(other.counts.size());
+      }
+      for (size_t i = 0; i < other.counts.size(); i++) {
+        counts[i] += other.counts[i];
+      }
+      count += other.count;
+      sum += other.sum;
+      return *this;
+    }
+
+    // `counts[i]` is the number of recorded values `v` such that
+    // `upper_bounds[i - 1] < v <= upper_bounds[i]`, where the missing bounds
+    // at both ends are treated as -/+ infinity. Therefore `counts` has one
+    // more element than `upper_bounds`. It is empty if nothing has been
+    // recorded yet.
+    std::vector<uint64_t> counts;
+    // The total number of recorded values.
+    uint64_t count;
+    // The sum of all recorded values.
+    double sum;
+  };
+
+  // Interface to the histogram local to a particular writer thread.
+  // Construction and destruction are thread-safe operations, but the
+  // `Record()` method is only thread-compatible.
+  class Local final {
+   public:
+    explicit Local(Histogram& histogram)
+        : histogram_(histogram), local_(histogram.rcu_) {}
+
+    // Records `value` into its bucket. The first call after each `Collect()`
+    // allocates the bucket counts, subsequent calls do no allocations.
+    void Record(double value) {
+      const std::vector<double>& bounds = histogram_.upper_bounds_;
+      auto snapshot = local_.Write();
+      if (snapshot->counts.empty()) {
+        snapshot->counts.resize(bounds.size() + 1);
+      }
+      snapshot->counts[std::lower_bound(bounds.begin(), bounds.end(), value) -
+                       bounds.begin()]++;
+      snapshot->count++;
+      snapshot->sum += value;
+    }
+
+   private:
+    const Histogram& histogram_;
+    ReverseRcu<Buckets>::Local local_;
+  };
+
+  // `upper_bounds` must be sorted in strictly increasing order.
+  explicit Histogram(std::vector<double> upper_bounds)
+      : upper_bounds_(std::move(upper_bounds)), rcu_(), lock_(), total_() {
+    total_.counts.resize(upper_bounds_.size() + 1);
+  }
+
+  const std::vector<double>& upper_bounds() const noexcept {
+    return upper_bounds_;
+  }
+
+  // Returns the distribution of all values recorded by all `Local` instances,
+  // including ones that have been destroyed, since the construction of the
+  // histogram.
+  //
+  // Thread-safe.
+  Buckets Collect() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    total_ += rcu_.Collect();
+    return total_;
+  }
+  // Same as above, but copies the distribution into `out`, reusing its
+  // allocated memory.
+  void Collect(Buckets& out) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    total_ += rcu_.Collect();
+    out.counts.assign(total_.counts.begin(), total_.counts.end());
+    out.count = total_.count;
+    out.sum = total_.sum;
+  }
+
+ private:
+  const std::vector<double> upper_bounds_;
+  ReverseRcu<Buckets> rcu_;
+  absl::Mutex lock_;
+  Buckets total_ GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_METRICS_H
@@ -0,0 +1,94 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/metrics.h"
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+
+TEST(CounterTest, IncrementAndCollect) {
+  Counter counter;
+  Counter::Local local1(counter);
+  {
+    Counter::Local local2(counter);
+    local2.Increment(10);
+  }
+  local1.Increment();
+  EXPECT_EQ(counter.Collect(), 11)
+      << "Should receive increments from both live and terminated threads";
+  local1.Increment(2);
+  EXPECT_EQ(counter.Collect(), 13) << "Counter must accumulate across collects";
+}
+
+TEST(CounterTest, ConcurrentIncrements) {
+  Counter counter;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&counter]() {
+      Counter::Local local(counter);
+      for (int j = 0; j < 1000; j++) {
+        local.Increment();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.Collect(), 4000);
+}
+
+TEST(GaugeTest, AddSubtractAndCollect) {
+  Gauge gauge;
+  Gauge::Local local1(gauge);
+  Gauge::Local local2(gauge);
+  local1.Add(5);
+  local2.Subtract(2);
+  EXPECT_EQ(gauge.Collect(), 3);
+  local2.Subtract(3);
+  EXPECT_EQ(gauge.Collect(), 0) << "Gauge must accumulate across collects";
+}
+
+TEST(HistogramTest, RecordAndCollect) {
+  Histogram histogram({1, 10, 100});
+  EXPECT_THAT(histogram.Collect().counts, ElementsAre(0, 0, 0, 0))
+      << "An empty histogram must still have all its buckets";
+  Histogram::Local local1(histogram);
+  {
+    Histogram::Local local2(histogram);
+    local2.Record(0.5);
+    local2.Record(1);
+    local2.Record(5);
+  }
+  local1.Record(1000);
+  Histogram::Buckets buckets = histogram.Collect();
+  EXPECT_THAT(buckets.counts, ElementsAre(2, 1, 0, 1));
+  EXPECT_EQ(buckets.count, 4);
+  EXPECT_EQ(buckets.sum, 1006.5);
+  local1.Record(50);
+  buckets = histogram.Collect();
+  EXPECT_THAT(buckets.counts, ElementsAre(2, 1, 1, 1))
+      << "Histogram must accumulate across collects";
+  EXPECT_EQ(buckets.count, 5);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,239 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_NUMA_H
+#define _SIMPLE_RCU_NUMA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+
+namespace simple_rcu {
+
+// Parses a list of CPUs or NUMA nodes in the Linux sysfs format, such as
+// "0-3,8,10-11". Returns an empty list if `list` is malformed.
+inline std::vector<int> ParseCpuList(absl::string_view list) {
+  std::vector<int> result;
+  for (absl::string_view range :
+       absl::StrSplit(list, absl::ByAnyChar(",\n"), absl::SkipWhitespace())) {
+    std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first;
+    int last;
+    if (!absl::SimpleAtoi(bounds.first, &first)) {
+      return {};
+    }
+    if (bounds.second.empty()) {
+      last = first;
+    } else if (!absl::SimpleAtoi(bounds.second, &last) || last < first) {
+      return {};
+    }
+    for (int cpu = first; cpu <= last; cpu++) {
+      result.push_back(cpu);
+    }
+  }
+  return result;
+}
+
+// Pins the current thread to the given set of CPUs.
+// Returns `false` if it isn't supported on this platform or fails.
+inline bool PinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+// Assignment of CPUs to NUMA nodes. Nodes are indexed densely from 0.
+class NumaTopology final {
+ public:
+  // Builds a topology with given CPUs for each node. Each node must have at
+  // least one CPU.
+  explicit NumaTopology(std::vector<std::vector<int>> node_cpus)
+      : node_cpus_(std::move(node_cpus)), cpu_nodes_() {
+    for (size_t node = 0; node < node_cpus_.size(); node++) {
+      for (int cpu : node_cpus_[node]) {
+        if (static_cast<size_t>(cpu) >= cpu_nodes_.size()) {
+          cpu_nodes_.resize(cpu + 1, 0);
+        }
+        cpu_nodes_[cpu] = static_cast<int>(node);
+      }
+    }
+  }
+
+  // Reads the topology of the machine from `/sys/devices/system/node`.
+  // If it isn't available, returns a single node with all CPUs.
+  static NumaTopology FromSystem() {
+    std::vector<std::vector<int>> node_cpus;
+    for (int node : ParseCpuList(ReadFile("/sys/devices/system/node/online"))) {
+      std::vector<int> cpus = ParseCpuList(ReadFile(
+          absl::StrCat("/sys/devices/system/node/node", node, "/cpulist")));
+      // Skip memory-only nodes.
+      if (!cpus.empty()) {
+        node_cpus.push_back(std::move(cpus));
+      }
+    }
+    if (node_cpus.empty()) {
+      node_cpus.emplace_back();
+      int cpu_count = static_cast<int>(std::thread::hardware_concurrency());
+      for (int cpu = 0; cpu < std::max(cpu_count, 1); cpu++) {
+        node_cpus.back().push_back(cpu);
+      }
+    }
+    return NumaTopology(std::move(node_cpus));
+  }
+
+  int nodes() const noexcept { return static_cast<int>(node_cpus_.size()); }
+  const std::vector<int>& cpus(int node) const { return node_cpus_[node]; }
+
+  // Returns the node of the CPU the current thread is running on. Unless the
+  // thread is pinned to the node, it can migrate to another one at any time.
+  int CurrentNode() const noexcept {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes_.size()) {
+      return cpu_nodes_[cpu];
+    }
+#endif
+    return 0;
+  }
+
+ private:
+  static std::string ReadFile(const std::string& path) {
+    std::ifstream file(path);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+  }
+
+  std::vector<std::vector<int>> node_cpus_;
+  // The node of each CPU.
+  std::vector<int> cpu_nodes_;
+};
+
+// A worker thread for each NUMA node, pinned to the node's CPUs, that runs
+// operations on node-local data.
+class NodeWorkers final {
+ public:
+  explicit NodeWorkers(const NumaTopology& topology)
+      : run_lock_(),
+        lock_(),
+        work_(),
+        done_(),
+        task_(nullptr),
+        generation_(0),
+        pending_(0),
+        stop_(false),
+        threads_() {
+    for (int node = 0; node < topology.nodes(); node++) {
+      threads_.emplace_back(&NodeWorkers::Work, this, node,
+                            topology.cpus(node));
+    }
+  }
+  ~NodeWorkers() LOCKS_EXCLUDED(lock_) {
+    {
+      absl::MutexLock mutex(&lock_);
+      stop_ = true;
+      work_.SignalAll();
+    }
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  int nodes() const noexcept { return static_cast<int>(threads_.size()); }
+
+  // Runs `task(node)` on the worker of each node in parallel and waits until
+  // all of them finish.
+  //
+  // Thread-safe, concurrent calls are serialized.
+  void RunOnEach(const std::function<void(int)>& task)
+      LOCKS_EXCLUDED(run_lock_, lock_) {
+    absl::MutexLock run_mutex(&run_lock_);
+    absl::MutexLock mutex(&lock_);
+    task_ = &task;
+    pending_ = nodes();
+    generation_++;
+    work_.SignalAll();
+    while (pending_ > 0) {
+      done_.Wait(&lock_);
+    }
+    task_ = nullptr;
+  }
+
+ private:
+  void Work(int node, std::vector<int> cpus) LOCKS_EXCLUDED(lock_) {
+    PinCurrentThread(cpus);
+    uint_fast64_t seen_generation = 0;
+    absl::MutexLock mutex(&lock_);
+    while (true) {
+      while (!stop_ && generation_ == seen_generation) {
+        work_.Wait(&lock_);
+      }
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+      const std::function<void(int)>& task = *task_;
+      lock_.Unlock();
+      task(node);
+      lock_.Lock();
+      if (--pending_ == 0) {
+        done_.Signal();
+      }
+    }
+  }
+
+  // Serializes `RunOnEach` calls.
+  absl::Mutex run_lock_ ACQUIRED_BEFORE(lock_);
+  absl::Mutex lock_;
+  // Signalled when a new task is available or the workers should stop.
+  absl::CondVar work_;
+  // Signalled when all workers finish a task.
+  absl::CondVar done_;
+  const std::function<void(int)>* task_ GUARDED_BY(lock_);
+  // Incremented with each new task.
+  uint_fast64_t generation_ GUARDED_BY(lock_);
+  // The number of workers that haven't finished the current task yet.
+  int pending_ GUARDED_BY(lock_);
+  bool stop_ GUARDED_BY(lock_);
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_NUMA_H
@@ -0,0 +1,67 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/numa.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(ParseCpuListTest, RangesAndSingleCpus) {
+  EXPECT_THAT(ParseCpuList("0-3,8,10-11\n"),
+              ElementsAre(0, 1, 2, 3, 8, 10, 11));
+  EXPECT_THAT(ParseCpuList("5"), ElementsAre(5));
+  EXPECT_THAT(ParseCpuList(""), IsEmpty());
+}
+
+TEST(ParseCpuListTest, Malformed) {
+  EXPECT_THAT(ParseCpuList("0-x"), IsEmpty());
+  EXPECT_THAT(ParseCpuList("3-1"), IsEmpty());
+  EXPECT_THAT(ParseCpuList("foo"), IsEmpty());
+}
+
+TEST(NumaTopologyTest, FromSystemHasCpus) {
+  NumaTopology topology = NumaTopology::FromSystem();
+  ASSERT_GE(topology.nodes(), 1);
+  for (int node = 0; node < topology.nodes(); node++) {
+    EXPECT_THAT(topology.cpus(node), ::testing::Not(IsEmpty()));
+  }
+  const int current = topology.CurrentNode();
+  EXPECT_GE(current, 0);
+  EXPECT_LT(current, topology.nodes());
+}
+
+TEST(NodeWorkersTest, RunsOnEachNode) {
+  NumaTopology topology({{0}, {0}, {0}});
+  NodeWorkers workers(topology);
+  ASSERT_EQ(workers.nodes(), 3);
+  std::vector<std::atomic<int>> runs(3);
+  for (int i = 0; i < 10; i++) {
+    workers.RunOnEach([&runs](int node) { runs[node]++; });
+  }
+  for (const std::atomic<int>& node_runs : runs) {
+    EXPECT_EQ(node_runs.load(), 10);
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu
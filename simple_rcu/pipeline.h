@@ -0,0 +1,155 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_PIPELINE_H
+#define _SIMPLE_RCU_PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// Hands the latest frame from one pipeline stage (the Producer) to the next
+// one (the Consumer) through a `Local3StateRcu`. Wait-free and allocation-free
+// on both sides.
+//
+// The Consumer always receives the most recent published frame. If the
+// Producer publishes a frame before the Consumer has received the previous
+// one, the previous frame is dropped (overwritten) and counted in `dropped()`.
+// This is what a latency-sensitive pipeline wants: a slow stage skips stale
+// intermediate frames instead of queueing them.
+//
+// Only one thread may call the Producer methods and only one the Consumer
+// methods at a time. The counters can be read by any thread.
+//
+// If `kAlignToCacheLines` is `true`, the state of the Producer and of the
+// Consumer are kept on separate cache lines. As with `Local3StateRcu`, such
+// instances should then be allocated statically, on the stack or as members
+// of such objects before C++17.
+template <typename T, bool kAlignToCacheLines = true>
+class PipelineLink final {
+ public:
+  PipelineLink() : rcu_(), producer_(), consumer_() {}
+  // Initializes all frames to `value`.
+  explicit PipelineLink(const T& value)
+      : rcu_(value), producer_(), consumer_() {}
+
+  // Producer: The frame to be published next. Its contents are those of an
+  // older frame, so the Producer must overwrite all of it.
+  T& Next() noexcept { return rcu_.Update(); }
+
+  // Producer: Publishes `Next()` to the Consumer, invalidating references
+  // previously returned by `Next()`. Returns `false` if the previously
+  // published frame hasn't been received and has therefore been dropped.
+  bool Publish() noexcept {
+    const bool received = rcu_.ForceUpdate();
+    Increment(producer_.published);
+    if (!received) {
+      Increment(producer_.dropped);
+    }
+    return received;
+  }
+
+  // Consumer: Advances `Received()` to the latest published frame. Returns
+  // `false` if nothing has been published since the last call, in which case
+  // `Received()` is left unchanged.
+  bool TryReceive() noexcept {
+    if (!rcu_.TryRead()) {
+      return false;
+    }
+    Increment(consumer_.received);
+    return true;
+  }
+
+  // Consumer: The last received frame.
+  T& Received() noexcept { return rcu_.Read(); }
+
+  // The number of frames published so far.
+  uint64_t published() const noexcept {
+    return producer_.published.load(std::memory_order_relaxed);
+  }
+  // The number of published frames overwritten before being received.
+  uint64_t dropped() const noexcept {
+    return producer_.dropped.load(std::memory_order_relaxed);
+  }
+  // The number of frames received so far.
+  uint64_t received() const noexcept {
+    return consumer_.received.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr std::size_t kAlignment =
+      kAlignToCacheLines ? kCacheLineSize : 1;
+
+  // Counters are written by a single thread, so a load and a store suffice
+  // instead of an atomic read-modify-write.
+  static void Increment(std::atomic<uint64_t>& counter) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  }
+
+  Local3StateRcu<T, kAlignToCacheLines> rcu_;
+  struct alignas(kAlignment) {
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> dropped{0};
+  } producer_;
+  struct alignas(kAlignment) {
+    std::atomic<uint64_t> received{0};
+  } consumer_;
+};
+
+template <typename T, bool kAlignToCacheLines>
+constexpr std::size_t PipelineLink<T, kAlignToCacheLines>::kAlignment;
+
+// A pipeline stage between two links: Consumer of `input` and Producer of
+// `output`. Stages are chained by passing the `output` of one as the `input`
+// of the next, each running on its own thread. The first stage of a pipeline
+// just publishes to a `PipelineLink` directly, the last one just receives from
+// it.
+template <typename In, typename Out, bool kAlignToCacheLines = true>
+class PipelineStage final {
+ public:
+  PipelineStage(PipelineLink<In, kAlignToCacheLines>& input,
+                PipelineLink<Out, kAlignToCacheLines>& output)
+      : input_(input), output_(output) {}
+
+  // If there is a new frame in `input`, calls `process(const In& frame,
+  // Out& next)` to fill the next frame of `output` and publishes it.
+  // Intermediate frames published to `input` since the last call are skipped
+  // (and counted in `input.dropped()`).
+  //
+  // Returns `true` if a frame has been processed.
+  template <typename F>
+  bool Poll(F&& process) {
+    if (!input_.TryReceive()) {
+      return false;
+    }
+    std::forward<F>(process)(static_cast<const In&>(input_.Received()),
+                             output_.Next());
+    output_.Publish();
+    return true;
+  }
+
+ private:
+  PipelineLink<In, kAlignToCacheLines>& input_;
+  PipelineLink<Out, kAlignToCacheLines>& output_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_PIPELINE_H
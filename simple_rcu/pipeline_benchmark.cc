@@ -0,0 +1,90 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/pipeline.h"
+
+namespace simple_rcu {
+namespace {
+
+struct Frame {
+  // When the frame left the first stage, in nanoseconds of `steady_clock`.
+  int64_t sent_ns;
+  uint64_t sequence;
+};
+
+int64_t NowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+constexpr int kMaxHops = 4;
+// Static, so that the links are aligned to cache lines.
+std::array<PipelineLink<Frame>, kMaxHops> links;
+
+// Runs a pipeline of `state.threads() - 1` hops: Thread 0 publishes
+// timestamped frames, each subsequent thread forwards them to the next link
+// and the last thread measures their end-to-end latency.
+//
+// Reports the mean latency from the first to the last stage, the mean latency
+// per hop and the fraction of frames dropped along the way.
+static void BM_PipelineLatency(benchmark::State& state) {
+  const int hops = state.threads() - 1;
+  const int index = state.thread_index();
+  if (index == 0) {
+    PipelineLink<Frame>& output = links[0];
+    uint64_t sequence = output.published();
+    for (auto _ : state) {
+      Frame& frame = output.Next();
+      frame.sent_ns = NowNanos();
+      frame.sequence = ++sequence;
+      output.Publish();
+    }
+  } else if (index < hops) {
+    PipelineStage<Frame, Frame> stage(links[index - 1], links[index]);
+    for (auto _ : state) {
+      benchmark::DoNotOptimize(
+          stage.Poll([](const Frame& in, Frame& out) { out = in; }));
+    }
+  } else {
+    PipelineLink<Frame>& input = links[hops - 1];
+    // Frames left in the links by previous runs are older than this.
+    const int64_t start_ns = NowNanos();
+    const uint64_t published_before = links[0].published();
+    int64_t latency_ns = 0;
+    int64_t frames = 0;
+    for (auto _ : state) {
+      if (input.TryReceive() && input.Received().sent_ns >= start_ns) {
+        latency_ns += NowNanos() - input.Received().sent_ns;
+        frames++;
+      }
+    }
+    const double sent =
+        static_cast<double>(links[0].published() - published_before);
+    const double mean_ns =
+        frames > 0 ? static_cast<double>(latency_ns) / frames : 0;
+    state.counters["latency_ns"] = mean_ns;
+    state.counters["hop_latency_ns"] = mean_ns / hops;
+    state.counters["dropped"] = sent > 0 ? 1 - frames / sent : 0;
+  }
+}
+BENCHMARK(BM_PipelineLatency)->Threads(2)->Threads(3)->Threads(kMaxHops + 1);
+
+}  // namespace
+}  // namespace simple_rcu
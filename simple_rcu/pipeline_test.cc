@@ -0,0 +1,96 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/pipeline.h"
+
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(PipelineLinkTest, ReceivesLatestFrameAndCountsDropped) {
+  PipelineLink<int> link;
+  EXPECT_FALSE(link.TryReceive()) << "Nothing has been published yet";
+  link.Next() = 1;
+  EXPECT_TRUE(link.Publish()) << "No frame has been overwritten";
+  link.Next() = 2;
+  EXPECT_FALSE(link.Publish()) << "Frame 1 hasn't been received";
+  ASSERT_TRUE(link.TryReceive());
+  EXPECT_EQ(link.Received(), 2);
+  EXPECT_FALSE(link.TryReceive());
+  EXPECT_EQ(link.Received(), 2) << "A failed receive keeps the last frame";
+  EXPECT_EQ(link.published(), 2);
+  EXPECT_EQ(link.dropped(), 1);
+  EXPECT_EQ(link.received(), 1);
+}
+
+TEST(PipelineStageTest, ProcessesOnlyNewFrames) {
+  PipelineLink<int> input;
+  PipelineLink<int64_t> output;
+  PipelineStage<int, int64_t> stage(input, output);
+  const auto twice = [](const int& in, int64_t& out) { out = 2 * in; };
+  EXPECT_FALSE(stage.Poll(twice));
+  input.Next() = 3;
+  input.Publish();
+  EXPECT_TRUE(stage.Poll(twice));
+  EXPECT_FALSE(stage.Poll(twice)) << "Frame 3 has already been processed";
+  ASSERT_TRUE(output.TryReceive());
+  EXPECT_EQ(output.Received(), 6);
+}
+
+TEST(PipelineStageTest, ChainedStagesDeliverTheLastFrame) {
+  constexpr int kFrames = 10000;
+  PipelineLink<int> first;
+  PipelineLink<int> second;
+  std::thread source([&first]() {
+    for (int i = 1; i <= kFrames; i++) {
+      first.Next() = i;
+      first.Publish();
+    }
+  });
+  std::thread stage_thread([&first, &second]() {
+    PipelineStage<int, int> stage(first, second);
+    int last = 0;
+    while (last < kFrames) {
+      if (!stage.Poll([&last](const int& in, int& out) {
+            EXPECT_GT(in, last) << "Frames must arrive in order";
+            last = in;
+            out = -in;
+          })) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  int last = 0;
+  while (last > -kFrames) {
+    if (second.TryReceive()) {
+      EXPECT_LT(second.Received(), last) << "Frames must arrive in order";
+      last = second.Received();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  source.join();
+  stage_thread.join();
+  EXPECT_EQ(first.published(), kFrames);
+  EXPECT_EQ(first.received() + first.dropped(), first.published())
+      << "Each frame must be either received or dropped";
+  EXPECT_EQ(second.received() + second.dropped(), second.published());
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,294 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_PROMETHEUS_H
+#define _SIMPLE_RCU_PROMETHEUS_H
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/metrics.h"
+
+namespace simple_rcu {
+
+// Exports metrics from `metrics.h` in the Prometheus text exposition format.
+//
+// Everything that doesn't change between scrapes - metric names, labels,
+// `# HELP` and `# TYPE` lines and histogram bucket bounds - is rendered once
+// when a metric is added. A scrape then just collects the metrics and appends
+// the pre-rendered text and their values to a caller-provided buffer in a
+// single pass. Once the buffer has grown to the size of the output, scrapes
+// don't allocate any memory for formatting.
+//
+// Added metrics must outlive the exporter.
+//
+// Thread-safe.
+class PrometheusExporter final {
+ public:
+  using Labels = std::vector<std::pair<std::string, std::string>>;
+
+  PrometheusExporter() : lock_(), series_() {}
+
+  // Adds a series of metric `name` with given `labels`. Series of the same
+  // `name` are exported together, with `help` of the first one.
+  //
+  // Returns `false` and doesn't add the series if `name` has already been
+  // added as a metric of a different type, which Prometheus would reject.
+  bool Add(Counter& counter, absl::string_view name, const Labels& labels = {},
+           absl::string_view help = "") LOCKS_EXCLUDED(lock_) {
+    return Insert(std::unique_ptr<Series>(
+        new CounterSeries(counter, name, Header(name, kCounter, help),
+                          Render(name, labels))));
+  }
+  bool Add(Gauge& gauge, absl::string_view name, const Labels& labels = {},
+           absl::string_view help = "") LOCKS_EXCLUDED(lock_) {
+    return Insert(std::unique_ptr<Series>(new GaugeSeries(
+        gauge, name, Header(name, kGauge, help), Render(name, labels))));
+  }
+  bool Add(Histogram& histogram, absl::string_view name,
+           const Labels& labels = {}, absl::string_view help = "")
+      LOCKS_EXCLUDED(lock_) {
+    return Insert(std::unique_ptr<Series>(new HistogramSeries(
+        histogram, name, Header(name, kHistogram, help), labels)));
+  }
+
+  // Collects all added metrics and writes them to `out`, replacing its
+  // previous contents but reusing its capacity.
+  void Scrape(std::string& out) LOCKS_EXCLUDED(lock_) {
+    out.clear();
+    absl::MutexLock mutex(&lock_);
+    const std::string* last_name = nullptr;
+    for (const auto& series : series_) {
+      if (last_name == nullptr || *last_name != series->name) {
+        out.append(series->header);
+        last_name = &series->name;
+      }
+      series->Write(out);
+    }
+  }
+
+ private:
+  // Metric types, as written in `# TYPE` lines.
+  static constexpr const char* kCounter = "counter";
+  static constexpr const char* kGauge = "gauge";
+  static constexpr const char* kHistogram = "histogram";
+
+  struct Series {
+    Series(absl::string_view name_, absl::string_view type_,
+           std::string header_)
+        : name(name_), type(type_), header(std::move(header_)) {}
+    virtual ~Series() = default;
+
+    // Collects the metric and appends its lines.
+    virtual void Write(std::string& out) = 0;
+
+    const std::string name;
+    // One of `kCounter`, `kGauge` and `kHistogram`.
+    const absl::string_view type;
+    // The `# HELP` and `# TYPE` lines of `name`.
+    const std::string header;
+  };
+
+  class CounterSeries final : public Series {
+   public:
+    CounterSeries(Counter& counter, absl::string_view name, std::string header,
+                  std::string prefix)
+        : Series(name, kCounter, std::move(header)),
+          counter_(counter),
+          prefix_(std::move(prefix)) {}
+
+    void Write(std::string& out) override {
+      out.append(prefix_);
+      absl::StrAppend(&out, counter_.Collect());
+      out.push_back('\n');
+    }
+
+   private:
+    Counter& counter_;
+    // `name{labels} `.
+    const std::string prefix_;
+  };
+
+  class GaugeSeries final : public Series {
+   public:
+    GaugeSeries(Gauge& gauge, absl::string_view name, std::string header,
+                std::string prefix)
+        : Series(name, kGauge, std::move(header)),
+          gauge_(gauge),
+          prefix_(std::move(prefix)) {}
+
+    void Write(std::string& out) override {
+      out.append(prefix_);
+      AppendDouble(out, gauge_.Collect());
+      out.push_back('\n');
+    }
+
+   private:
+    Gauge& gauge_;
+    const std::string prefix_;
+  };
+
+  class HistogramSeries final : public Series {
+   public:
+    HistogramSeries(Histogram& histogram, absl::string_view name,
+                    std::string header, const Labels& labels)
+        : Series(name, kHistogram, std::move(header)),
+          histogram_(histogram),
+          buckets_(),
+          bucket_prefixes_(),
+          sum_prefix_(Render(absl::StrCat(name, "_sum"), labels)),
+          count_prefix_(Render(absl::StrCat(name, "_count"), labels)) {
+      const std::string bucket = absl::StrCat(name, "_bucket");
+      Labels bucket_labels = labels;
+      bucket_labels.emplace_back("le", "");
+      for (double bound : histogram.upper_bounds()) {
+        bucket_labels.back().second.clear();
+        AppendDouble(bucket_labels.back().second, bound);
+        bucket_prefixes_.push_back(Render(bucket, bucket_labels));
+      }
+      bucket_labels.back().second = "+Inf";
+      bucket_prefixes_.push_back(Render(bucket, bucket_labels));
+    }
+
+    void Write(std::string& out) override {
+      histogram_.Collect(buckets_);
+      // Prometheus buckets are cumulative.
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < bucket_prefixes_.size(); i++) {
+        cumulative += buckets_.counts[i];
+        out.append(bucket_prefixes_[i]);
+        absl::StrAppend(&out, cumulative);
+        out.push_back('\n');
+      }
+      out.append(sum_prefix_);
+      AppendDouble(out, buckets_.sum);
+      out.push_back('\n');
+      out.append(count_prefix_);
+      absl::StrAppend(&out, buckets_.count);
+      out.push_back('\n');
+    }
+
+   private:
+    Histogram& histogram_;
+    // Reused by each `Write`.
+    Histogram::Buckets buckets_;
+    // One for each bucket of `histogram_`, the last one for "+Inf".
+    std::vector<std::string> bucket_prefixes_;
+    const std::string sum_prefix_;
+    const std::string count_prefix_;
+  };
+
+  // Adds `series` after the last series of the same name, if any. Returns
+  // `false` if they're of a different type.
+  bool Insert(std::unique_ptr<Series> series) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    auto position = series_.end();
+    for (auto it = series_.begin(); it != series_.end(); ++it) {
+      if ((*it)->name == series->name) {
+        if ((*it)->type != series->type) {
+          return false;
+        }
+        position = it + 1;
+      }
+    }
+    series_.insert(position, std::move(series));
+    return true;
+  }
+
+  static std::string Header(absl::string_view name, absl::string_view type,
+                            absl::string_view help) {
+    std::string header;
+    if (!help.empty()) {
+      absl::StrAppend(&header, "# HELP ", name, " ");
+      for (char c : help) {
+        if (c == '\\') {
+          header.append("\\\\");
+        } else if (c == '\n') {
+          header.append("\\n");
+        } else {
+          header.push_back(c);
+        }
+      }
+      header.push_back('\n');
+    }
+    absl::StrAppend(&header, "# TYPE ", name, " ", type, "\n");
+    return header;
+  }
+
+  // Renders `name{label="value",...} `, with label values escaped.
+  static std::string Render(absl::string_view name, const Labels& labels) {
+    std::string result(name);
+    if (!labels.empty()) {
+      result.push_back('{');
+      for (size_t i = 0; i < labels.size(); i++) {
+        if (i > 0) {
+          result.push_back(',');
+        }
+        absl::StrAppend(&result, labels[i].first, "=\"");
+        for (char c : labels[i].second) {
+          if (c == '\\' || c == '"') {
+            result.push_back('\\');
+            result.push_back(c);
+          } else if (c == '\n') {
+            result.append("\\n");
+          } else {
+            result.push_back(c);
+          }
+        }
+        result.push_back('"');
+      }
+      result.push_back('}');
+    }
+    result.push_back(' ');
+    return result;
+  }
+
+  // Appends `value` with enough digits to be parsed back exactly, without
+  // allocating. Values such as 0.1 that round-trip with 15 digits are written
+  // in that shorter form. Unlike `snprintf` and `strtod`, the functions used
+  // don't depend on the C locale, which could change the decimal point.
+  static void AppendDouble(std::string& out, double value) {
+    if (std::isnan(value)) {
+      out.append("NaN");
+    } else if (std::isinf(value)) {
+      out.append(value > 0 ? "+Inf" : "-Inf");
+    } else {
+      char buffer[32];
+      int length = absl::SNPrintF(buffer, sizeof(buffer), "%.15g", value);
+      double parsed;
+      if (!absl::SimpleAtod(absl::string_view(buffer, length), &parsed) ||
+          parsed != value) {
+        length = absl::SNPrintF(buffer, sizeof(buffer), "%.17g", value);
+      }
+      out.append(buffer, static_cast<size_t>(length));
+    }
+  }
+
+  absl::Mutex lock_;
+  // Series of the same name are adjacent.
+  std::vector<std::unique_ptr<Series>> series_ GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_PROMETHEUS_H
@@ -0,0 +1,49 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/metrics.h"
+#include "simple_rcu/prometheus.h"
+
+namespace simple_rcu {
+namespace {
+
+// Scrapes `state.range(0)` counters and as many histograms, each with a label.
+static void BM_Scrape(benchmark::State& state) {
+  const int series = static_cast<int>(state.range(0));
+  std::vector<std::unique_ptr<Counter>> counters;
+  std::vector<std::unique_ptr<Histogram>> histograms;
+  PrometheusExporter exporter;
+  for (int i = 0; i < series; i++) {
+    const std::string shard = std::to_string(i);
+    counters.emplace_back(new Counter());
+    exporter.Add(*counters.back(), "requests_total", {{"shard", shard}});
+    histograms.emplace_back(new Histogram({0.001, 0.01, 0.1, 1}));
+    exporter.Add(*histograms.back(), "latency_seconds", {{"shard", shard}});
+  }
+  std::string out;
+  for (auto _ : state) {
+    exporter.Scrape(out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+BENCHMARK(BM_Scrape)->Arg(1)->Arg(64)->Arg(1024);
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,144 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/prometheus.h"
+
+#include <clocale>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/metrics.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(PrometheusExporterTest, ScrapesCountersAndGauges) {
+  Counter get;
+  Counter post;
+  Gauge temperature;
+  PrometheusExporter exporter;
+  exporter.Add(get, "requests_total", {{"method", "GET"}}, "Requests.");
+  exporter.Add(temperature, "temperature");
+  exporter.Add(post, "requests_total", {{"method", "POST"}});
+  Counter::Local(get).Increment(3);
+  Counter::Local(post).Increment();
+  Gauge::Local(temperature).Add(21.5);
+  std::string out;
+  exporter.Scrape(out);
+  EXPECT_EQ(out,
+            "# HELP requests_total Requests.\n"
+            "# TYPE requests_total counter\n"
+            "requests_total{method=\"GET\"} 3\n"
+            "requests_total{method=\"POST\"} 1\n"
+            "# TYPE temperature gauge\n"
+            "temperature 21.5\n")
+      << "Series of the same name must be grouped under a single header";
+}
+
+TEST(PrometheusExporterTest, ScrapesHistograms) {
+  Histogram histogram({0.1, 1});
+  PrometheusExporter exporter;
+  exporter.Add(histogram, "latency_seconds", {{"path", "/"}});
+  {
+    Histogram::Local local(histogram);
+    local.Record(0.05);
+    local.Record(0.5);
+    local.Record(2);
+  }
+  std::string out;
+  exporter.Scrape(out);
+  EXPECT_EQ(out,
+            "# TYPE latency_seconds histogram\n"
+            "latency_seconds_bucket{path=\"/\",le=\"0.1\"} 1\n"
+            "latency_seconds_bucket{path=\"/\",le=\"1\"} 2\n"
+            "latency_seconds_bucket{path=\"/\",le=\"+Inf\"} 3\n"
+            "latency_seconds_sum{path=\"/\"} 2.55\n"
+            "latency_seconds_count{path=\"/\"} 3\n");
+}
+
+TEST(PrometheusExporterTest, WritesDoublesThatRoundTrip) {
+  Gauge gauge;
+  PrometheusExporter exporter;
+  exporter.Add(gauge, "g");
+  Gauge::Local(gauge).Add(0.1 + 0.2);
+  std::string out;
+  exporter.Scrape(out);
+  EXPECT_EQ(out,
+            "# TYPE g gauge\n"
+            "g 0.30000000000000004\n");
+}
+
+TEST(PrometheusExporterTest, WritesDoublesRegardlessOfLocale) {
+  const std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  if (std::setlocale(LC_NUMERIC, "de_DE.UTF-8") == nullptr) {
+    GTEST_SKIP() << "A locale with a decimal comma isn't available";
+  }
+  Gauge gauge;
+  PrometheusExporter exporter;
+  exporter.Add(gauge, "g");
+  Gauge::Local(gauge).Add(21.5);
+  std::string out;
+  exporter.Scrape(out);
+  std::setlocale(LC_NUMERIC, previous.c_str());
+  EXPECT_EQ(out,
+            "# TYPE g gauge\n"
+            "g 21.5\n");
+}
+
+TEST(PrometheusExporterTest, RejectsNamesOfDifferentTypes) {
+  Counter counter1;
+  Counter counter2;
+  Gauge gauge;
+  PrometheusExporter exporter;
+  EXPECT_TRUE(exporter.Add(counter1, "m", {{"a", "1"}}));
+  EXPECT_FALSE(exporter.Add(gauge, "m"))
+      << "A name can't be exported as metrics of different types";
+  EXPECT_TRUE(exporter.Add(counter2, "m", {{"a", "2"}}));
+  std::string out;
+  exporter.Scrape(out);
+  EXPECT_EQ(out,
+            "# TYPE m counter\n"
+            "m{a=\"1\"} 0\n"
+            "m{a=\"2\"} 0\n");
+}
+
+TEST(PrometheusExporterTest, EscapesLabelValuesAndHelp) {
+  Counter counter;
+  PrometheusExporter exporter;
+  exporter.Add(counter, "c", {{"a", "x\"y\\z\n"}, {"b", ""}}, "Line\nbreak");
+  std::string out;
+  exporter.Scrape(out);
+  EXPECT_EQ(out,
+            "# HELP c Line\\nbreak\n"
+            "# TYPE c counter\n"
+            "c{a=\"x\\\"y\\\\z\\n\",b=\"\"} 0\n");
+}
+
+TEST(PrometheusExporterTest, ReusesBuffer) {
+  Counter counter;
+  Histogram histogram({1, 2, 3});
+  PrometheusExporter exporter;
+  exporter.Add(counter, "c");
+  exporter.Add(histogram, "h");
+  std::string out;
+  exporter.Scrape(out);
+  const char* data = out.data();
+  const size_t capacity = out.capacity();
+  exporter.Scrape(out);
+  EXPECT_EQ(out.data(), data) << "A scrape of the same size must not reallocate";
+  EXPECT_EQ(out.capacity(), capacity);
+}
+
+}  // namespace
+}  // namespace simple_rcu
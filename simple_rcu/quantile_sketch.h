@@ -0,0 +1,133 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_QUANTILE_SKETCH_H
+#define _SIMPLE_RCU_QUANTILE_SKETCH_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace simple_rcu {
+
+// Fixed-memory sketch of a distribution of positive values that answers
+// quantile queries with a bounded relative error, in the style of DDSketch.
+//
+// Values are counted in logarithmically sized buckets: bucket `i` covers
+// `(kMinValue * kGamma^(i-1), kMinValue * kGamma^i]`, so any value within the
+// covered range is estimated with a relative error of at most
+// `kRelativeAccuracy`. Values outside of the range are clamped into the first
+// or the last bucket. With the defaults the range is from 1e-9 to about
+// 6e8, for example latencies in seconds from a nanosecond to years.
+//
+// `Record` is O(1) and never allocates. The buckets are a single contiguous
+// array, so that merging two sketches by `operator+=`, as done by
+// `ReverseRcu::Collect`, is a simple loop that compilers vectorize.
+//
+// Satisfies the `ReverseRcu` requirements.
+template <size_t kBuckets = 2048>
+class QuantileSketch {
+ public:
+  static constexpr double kRelativeAccuracy = 0.01;
+  static constexpr double kMinValue = 1e-9;
+
+  QuantileSketch() : counts_(), count_(0), sum_(0) {}
+
+  QuantileSketch& operator+=(const QuantileSketch& other) {
+    for (size_t i = 0; i < kBuckets; i++) {
+      counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    return *this;
+  }
+
+  // Records `value`. O(1), doesn't allocate.
+  void Record(double value) noexcept {
+    counts_[Index(value)]++;
+    count_++;
+    sum_ += value;
+  }
+
+  // Returns an estimate of the `q`-quantile, 0 <= q <= 1, of the recorded
+  // values, or 0 if nothing has been recorded.
+  double Quantile(double q) const noexcept {
+    if (count_ == 0) {
+      return 0;
+    }
+    // The 0-based rank of the requested value.
+    const uint64_t rank =
+        static_cast<uint64_t>(q * static_cast<double>(count_ - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+      seen += counts_[i];
+      if (seen > rank) {
+        return Value(i);
+      }
+    }
+    return Value(kBuckets - 1);
+  }
+
+  uint64_t count() const noexcept { return count_; }
+  double sum() const noexcept { return sum_; }
+  // The number of values recorded in each bucket.
+  const std::array<uint64_t, kBuckets>& counts() const noexcept {
+    return counts_;
+  }
+
+ private:
+  static constexpr double kGamma =
+      (1 + kRelativeAccuracy) / (1 - kRelativeAccuracy);
+  // `log(kGamma)` expanded into its Taylor series, since `std::log` isn't
+  // `constexpr`. The remaining terms are negligible for small
+  // `kRelativeAccuracy`.
+  static constexpr double kLogGamma =
+      2 * (kRelativeAccuracy +
+           kRelativeAccuracy * kRelativeAccuracy * kRelativeAccuracy / 3 +
+           kRelativeAccuracy * kRelativeAccuracy * kRelativeAccuracy *
+               kRelativeAccuracy * kRelativeAccuracy / 5);
+
+  static size_t Index(double value) noexcept {
+    if (!(value > kMinValue)) {
+      return 0;
+    }
+    const double index = std::ceil(std::log(value / kMinValue) / kLogGamma);
+    return index < kBuckets ? static_cast<size_t>(index) : kBuckets - 1;
+  }
+
+  // The estimate of values in bucket `index`, with the same relative error to
+  // both of its bounds.
+  static double Value(size_t index) noexcept {
+    return kMinValue * std::pow(kGamma, static_cast<double>(index)) * 2 /
+           (kGamma + 1);
+  }
+
+  alignas(64) std::array<uint64_t, kBuckets> counts_;
+  uint64_t count_;
+  double sum_;
+};
+
+template <size_t kBuckets>
+constexpr double QuantileSketch<kBuckets>::kRelativeAccuracy;
+template <size_t kBuckets>
+constexpr double QuantileSketch<kBuckets>::kMinValue;
+template <size_t kBuckets>
+constexpr double QuantileSketch<kBuckets>::kGamma;
+template <size_t kBuckets>
+constexpr double QuantileSketch<kBuckets>::kLogGamma;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_QUANTILE_SKETCH_H
@@ -0,0 +1,68 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/quantile_sketch.h"
+
+namespace simple_rcu {
+namespace {
+
+static void BM_Record(benchmark::State& state) {
+  QuantileSketch<> sketch;
+  double value = 1e-6;
+  for (auto _ : state) {
+    sketch.Record(value);
+    value = value < 1 ? value * 1.1 : 1e-6;
+  }
+  benchmark::DoNotOptimize(sketch);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Record);
+
+static void BM_Merge(benchmark::State& state) {
+  QuantileSketch<> sketch;
+  QuantileSketch<> other;
+  other.Record(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(other);
+    sketch += other;
+    benchmark::DoNotOptimize(sketch);
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(other.counts()));
+}
+BENCHMARK(BM_Merge);
+
+// Baseline for `BM_Merge`, adding buckets one by one through `volatile`, which
+// prevents the compiler from vectorizing the loop.
+static void BM_ScalarMerge(benchmark::State& state) {
+  std::array<uint64_t, 2048> counts = {};
+  std::array<uint64_t, 2048> other = {};
+  other[0] = 1;
+  for (auto _ : state) {
+    volatile uint64_t* target = counts.data();
+    const volatile uint64_t* source = other.data();
+    for (size_t i = 0; i < counts.size(); i++) {
+      target[i] += source[i];
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * sizeof(other));
+}
+BENCHMARK(BM_ScalarMerge);
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,90 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/quantile_sketch.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+constexpr double kError = QuantileSketch<>::kRelativeAccuracy * 1.0001;
+
+TEST(QuantileSketchTest, EmptyQuantile) {
+  QuantileSketch<> sketch;
+  EXPECT_EQ(sketch.count(), 0);
+  EXPECT_EQ(sketch.Quantile(0.5), 0);
+}
+
+TEST(QuantileSketchTest, QuantilesWithinRelativeAccuracy) {
+  QuantileSketch<> sketch;
+  for (int i = 1; i <= 1000; i++) {
+    sketch.Record(i * 0.001);
+  }
+  EXPECT_EQ(sketch.count(), 1000);
+  EXPECT_NEAR(sketch.sum(), 500.5, 1e-9);
+  EXPECT_NEAR(sketch.Quantile(0), 0.001, 0.001 * kError);
+  EXPECT_NEAR(sketch.Quantile(0.5), 0.5, 0.5 * kError);
+  EXPECT_NEAR(sketch.Quantile(0.99), 0.99, 0.99 * kError);
+  EXPECT_NEAR(sketch.Quantile(1), 1, kError);
+}
+
+TEST(QuantileSketchTest, OutOfRangeValuesAreClamped) {
+  QuantileSketch<> sketch;
+  sketch.Record(0);
+  sketch.Record(-1);
+  sketch.Record(1e30);
+  EXPECT_EQ(sketch.counts().front(), 2);
+  EXPECT_EQ(sketch.counts().back(), 1);
+}
+
+TEST(QuantileSketchTest, MergeEqualsRecordingAll) {
+  QuantileSketch<> all;
+  QuantileSketch<> odd;
+  QuantileSketch<> even;
+  for (int i = 1; i <= 100; i++) {
+    all.Record(i);
+    (i % 2 ? odd : even).Record(i);
+  }
+  odd += even;
+  EXPECT_EQ(odd.counts(), all.counts());
+  EXPECT_EQ(odd.count(), all.count());
+  EXPECT_EQ(odd.sum(), all.sum());
+}
+
+TEST(QuantileSketchTest, CollectFromThreads) {
+  ReverseRcu<QuantileSketch<>> rcu;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&rcu]() {
+      ReverseRcu<QuantileSketch<>>::Local local(rcu);
+      for (int i = 1; i <= 100; i++) {
+        local.Write()->Record(i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  QuantileSketch<> sketch = rcu.Collect();
+  EXPECT_EQ(sketch.count(), 400);
+  EXPECT_NEAR(sketch.Quantile(0.5), 50, 50 * kError);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -1,20 +1,82 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RCU_H
+#define _SIMPLE_RCU_RCU_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
-#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "simple_rcu/local_3state_rcu.h"
+#include "simple_rcu/local_registry.h"
+#include "simple_rcu/reclaimer.h"
+#include "simple_rcu/stats_policy.h"
+#include "simple_rcu/thread_local_locals.h"
 
 namespace simple_rcu {
 
+class RcuBatch;
+
 // Generic, user-space RCU implementation with fast, atomic, lock-free reads.
 //
 // `T` must be copyable. Commonly it's `std::shared_ptr<const U>`.
-template <typename T>
+//
+// `Stats` is a policy that records statistics about updates and reads, see
+// `NoRcuStats`. By default nothing is recorded.
+template <typename T, typename Stats = NoRcuStats>
 class Rcu {
  public:
   class Local;
   using MutableT = typename std::remove_const<T>::type;
 
+ private:
+  // A value together with its version, as passed to `Local` instances.
+  struct Versioned {
+    Versioned() : value(), version(0) {}
+    Versioned(MutableT value_, uint64_t version_)
+        : value(std::move(value_)), version(version_) {}
+
+    MutableT value;
+    uint64_t version;
+  };
+  using LocalRcu = Local3StateRcu<Versioned>;
+  // The state of a `Local` visited by updates and by `Synchronize`.
+  struct Shard {
+    Shard() : local_rcu(), read_version(0), wait_version(0) {}
+
+    LocalRcu local_rcu;
+    // The version of the value last obtained by the reader. Published by the
+    // reader only when it advances to a new value.
+    std::atomic<uint64_t> read_version;
+    // If non-zero, `Synchronize` waits for `read_version` to reach it.
+    std::atomic<uint64_t> wait_version;
+  };
+  using Registry = LocalRegistry<Shard, /*kReclaimDead=*/true>;
+
+ public:
+
   static_assert(std::is_default_constructible<MutableT>::value,
                 "T must be default constructible");
   static_assert(std::is_copy_constructible<MutableT>::value &&
@@ -33,19 +95,36 @@ class Rcu {
     Snapshot& operator=(Snapshot&&) = delete;
     Snapshot& operator=(const Snapshot&) = delete;
 
-    ~Snapshot() noexcept { registrar_.snapsnot_depth_--; }
+    ~Snapshot() noexcept { registrar_.snapshot_depth_--; }
 
     const T* operator->() const noexcept { return &**this; }
     T* operator->() noexcept { return &**this; }
     const T& operator*() const noexcept {
-      return *registrar_.local_rcu_.Read();
+      return registrar_.local_rcu().Read().value;
+    }
+    T& operator*() noexcept { return registrar_.local_rcu().Read().value; }
+
+    // The version of the value. It is 0 for the initial value of the RCU and
+    // incremented by each update. Allows readers to cheaply check if the value
+    // has changed, for example to rebuild state derived from it.
+    uint64_t version() const noexcept {
+      return registrar_.local_rcu().Read().version;
     }
-    T& operator*() noexcept { return registrar_.local_rcu_.Read(); }
+    // Returns `true` if the outermost `Snapshot` obtained a newly distributed
+    // value, `false` if it kept the value of the previous one. Note that a new
+    // value can still have the same `version()` as the previous one, if it was
+    // distributed while the `Local` was being constructed.
+    bool advanced() const noexcept { return registrar_.advanced_; }
 
    private:
     Snapshot(Local& registrar) noexcept : registrar_(registrar) {
-      if (registrar_.snapsnot_depth_++ == 0) {
-        registrar_.local_rcu_.TryRead();
+      if (registrar_.snapshot_depth_++ == 0) {
+        registrar_.advanced_ = registrar_.local_rcu().TryRead();
+        if (registrar_.advanced_) {
+          registrar_.Advanced();
+        }
+        registrar_.rcu_.stats_.RecordRead(registrar_.stats_reader_,
+                                          registrar_.advanced_);
       }
     }
 
@@ -60,16 +139,33 @@ class Rcu {
   // separate `Local` instance for each reader thread.
   class Local final {
    public:
-    // Thread-safe.
-    Local(Rcu& rcu) LOCKS_EXCLUDED(rcu.lock_)
-        : rcu_(rcu), snapsnot_depth_(0), local_rcu_() {
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.threads_.insert(this);
-      Update(rcu_.value_);
+    // Thread-safe. Registration is lock-free, except for briefly acquiring
+    // `rcu.value_lock_` to copy the current value. It never waits for an
+    // ongoing distribution of a value by `Update`.
+    Local(Rcu& rcu) LOCKS_EXCLUDED(rcu.value_lock_)
+        : rcu_(rcu),
+          node_(rcu.threads_.Add()),
+          stats_reader_(rcu.stats_),
+          snapshot_depth_(0),
+          advanced_(false) {
+      absl::MutexLock mutex(&rcu.value_lock_);
+      // An `Update` running concurrently might have missed the new node.
+      // Therefore read the current value directly. Any values already passed
+      // by `Update` are at most as recent, so drop them first.
+      local_rcu().TryRead();
+      local_rcu().Read().value = rcu.value_;
+      local_rcu().Read().version = rcu.version_;
+      node_->value().read_version.store(rcu.version_);
     }
-    ~Local() LOCKS_EXCLUDED(rcu_.lock_) {
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.threads_.erase(this);
+    // Thread-safe and wait-free, unless this is the last `Local` that
+    // `Synchronize` is waiting for, which is then notified.
+    ~Local() {
+      // Makes a concurrent `Synchronize` that hasn't visited this `Local` yet
+      // skip it, like a reader that has advanced. One that has already set
+      // `wait_version` is released by `ReaderPassed`.
+      node_->value().read_version.store(UINT64_MAX);
+      rcu_.ReaderPassed(node_->value());
+      Registry::Remove(node_);
     }
 
     // Obtains a read snapshot to the current value held by the RCU.
@@ -77,29 +173,126 @@ class Rcu {
     // Thread-compatible, but not thread-safe.
     Snapshot Read() noexcept { return Snapshot(*this); }
 
+    // Blocks until a value newer than the one in the last outermost `Snapshot`
+    // is available to `Read()`, or until `deadline`. Returns `true` in the
+    // former case, `false` on timeout. Use `absl::InfiniteFuture()` to wait
+    // indefinitely.
+    //
+    // Updates only wake up waiting threads if there are any, so that
+    // otherwise they pay just a single atomic load.
+    //
+    // Must not be called while the current thread holds a `Snapshot` obtained
+    // from this `Local`. Such a `Snapshot` keeps its value, so once an update
+    // is available, it would stay available and each call would return `true`
+    // immediately.
+    // Thread-compatible, but not thread-safe.
+    bool WaitForUpdate(absl::Time deadline) LOCKS_EXCLUDED(rcu_.wait_lock_) {
+      assert(snapshot_depth_ == 0);
+      if (local_rcu().CanRead()) {
+        return true;
+      }
+      rcu_.waiters_.fetch_add(1);
+      // Pairs with the fence in `Rcu::WakeWaiters()`: Either it observes this
+      // waiter, or the check below observes the new value.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool updated;
+      {
+        absl::MutexLock mutex(&rcu_.wait_lock_);
+        while (!(updated = local_rcu().CanRead()) &&
+               !rcu_.updated_.WaitWithDeadline(&rcu_.wait_lock_, deadline)) {
+        }
+      }
+      rcu_.waiters_.fetch_sub(1);
+      return updated || local_rcu().CanRead();
+    }
+
    private:
-    // Thread-compatible.
-    void Update(MutableT value) EXCLUSIVE_LOCKS_REQUIRED(rcu_.lock_) {
-      std::swap(local_rcu_.Update(), value);
-      local_rcu_.ForceUpdate();
-      // As a small performance optimization, destroy old `value` only after
-      // triggering update with the new value.
+    LocalRcu& local_rcu() noexcept { return node_->value().local_rcu; }
+
+    // Publishes the version of the value obtained by `TryRead()` and
+    // notifies `Synchronize` if it's waiting for it.
+    void Advanced() noexcept {
+      Shard& shard = node_->value();
+      const uint64_t version = local_rcu().Read().version;
+      // Sequentially consistent, pairs with `Synchronize`: Either it observes
+      // the new version, or this observes its `wait_version`.
+      shard.read_version.store(version);
+      const uint64_t wait_version = shard.wait_version.load();
+      if (wait_version != 0 && version >= wait_version) {
+        rcu_.ReaderPassed(shard);
+      }
     }
 
     Rcu& rcu_;
+    typename Registry::Node* const node_;
+    // Registered with `Stats` here, so that recording reads never allocates.
+    typename Stats::Reader stats_reader_;
     // Incremented with each `Snapshot` instance. Ensures that `TryRead` is
     // invoked only for the outermost `Snapshot`, keeping its value unchanged
     // for its whole lifetime.
-    int_fast16_t snapsnot_depth_;
-    Local3StateRcu<MutableT> local_rcu_;
+    int_fast16_t snapshot_depth_;
+    // Whether the outermost `Snapshot` obtained a new value.
+    bool advanced_;
 
     friend class Rcu;
   };
 
   // Constructs a RCU with an initial value `T()`.
   Rcu() : Rcu(T()) {}
-  Rcu(T initial_value)
-      : lock_(), value_(std::move(initial_value)), threads_() {}
+  // If `reclaimer` is given, old values replaced in `Local` instances are
+  // passed to it. Otherwise they're destroyed by the updating thread, after it
+  // releases the internal locks. `reclaimer` must outlive the RCU.
+  Rcu(T initial_value, Reclaimer* reclaimer = nullptr)
+      : reclaimer_(reclaimer),
+        lock_(),
+        value_lock_(),
+        value_(std::move(initial_value)),
+        version_(0),
+        threads_(),
+        pending_(nullptr),
+        distributing_(false),
+        wait_lock_(),
+        updated_(),
+        waiters_(0),
+        synchronize_lock_(),
+        grace_lock_(),
+        lagging_(0),
+        abort_grace_(false),
+        callbacks_lock_(),
+        callbacks_(),
+        stop_(false),
+        callbacks_thread_(),
+        stats_(),
+        retired_lock_(),
+        retired_(),
+        thread_locals_(*this) {}
+  // All `Local` instances must be destroyed before. Runs all callbacks passed
+  // to `CallRcu` that haven't run yet.
+  ~Rcu() LOCKS_EXCLUDED(callbacks_lock_) {
+    {
+      absl::MutexLock mutex(&callbacks_lock_);
+      stop_ = true;
+    }
+    {
+      // `callbacks_thread_` might be waiting for a `ThreadLocal()` reader that
+      // has stopped reading.
+      absl::MutexLock mutex(&grace_lock_);
+      abort_grace_ = true;
+    }
+    if (callbacks_thread_.joinable()) {
+      callbacks_thread_.join();
+    }
+    std::vector<std::function<void()>> callbacks;
+    {
+      absl::MutexLock mutex(&callbacks_lock_);
+      callbacks.swap(callbacks_);
+    }
+    // There are no readers left, so the grace period is over.
+    for (auto& callback : callbacks) {
+      callback();
+    }
+    delete pending_.load();
+  }
 
   // Updates `value` in all registered `Local` threads.
   // Returns the previous value. Note that the previous value can still be
@@ -111,21 +304,517 @@ class Rcu {
   //
   // Thread-safe.
   T Update(typename std::remove_const<T>::type value) LOCKS_EXCLUDED(lock_) {
-    absl::MutexLock mutex(&lock_);
-    std::swap(value_, value);
-    for (Local* thread : threads_) {
-      thread->Update(value_);
-    }
+    std::vector<MutableT> retired = TakeRetiredBuffer();
+    LockedUpdate([&]() EXCLUSIVE_LOCKS_REQUIRED(lock_) -> size_t {
+      Swap(value);
+      return Distribute(retired);
+    });
+    Reclaim(retired);
     return value;
   }
 
+  // Updates `value` in all registered `Local` threads, like `Update`, but
+  // concurrent callers of this method never wait for each other.
+  //
+  // If another thread is currently distributing a value, `value` is handed
+  // over to it and this method returns immediately. The other thread then
+  // distributes `value` after it finishes. If multiple values are handed over
+  // this way before the other thread gets to them, only the last one is
+  // distributed ("last writer wins") and the superseded ones are never
+  // observed by readers.
+  //
+  // Unlike `Update`, the previous value isn't returned, as it might not have
+  // been distributed at all.
+  //
+  // Thread-safe.
+  void UpdateCoalescing(MutableT value) LOCKS_EXCLUDED(lock_) {
+    // Destroys a superseded value, if any.
+    delete pending_.exchange(new MutableT(std::move(value)));
+    // If `distributing_` is set, the thread that set it is responsible for
+    // distributing `pending_`.
+    while (!distributing_.exchange(true)) {
+      std::vector<MutableT> retired = TakeRetiredBuffer();
+      LockedUpdate([&]() EXCLUSIVE_LOCKS_REQUIRED(lock_) -> size_t {
+        size_t locals = 0;
+        std::unique_ptr<MutableT> next;
+        while (next.reset(pending_.exchange(nullptr)), next != nullptr) {
+          Swap(*next);
+          locals = Distribute(retired);
+        }
+        return locals;
+      });
+      distributing_.store(false);
+      Reclaim(retired);
+      // Another caller might have handed over its value after the last
+      // `exchange` above, but before `distributing_` was cleared.
+      if (pending_.load() == nullptr) {
+        return;
+      }
+    }
+  }
+
+  // Returns the `Local` instance of the current thread, registering it on
+  // first use. It's unregistered when the thread exits, or just discarded if
+  // this RCU is destroyed first. This avoids managing `Local` instances
+  // manually, in particular for dynamically created RCUs.
+  //
+  // Thread-safe. O(1) and lock-free, except for the first call on a thread.
+  // Such a `Local` is waited for by `Synchronize` like any other, until its
+  // thread exits.
+  Local& ThreadLocal() { return thread_locals_.Get(); }
+
+  // The statistics recorded by this RCU.
+  Stats& stats() noexcept { return stats_; }
+
+  // Blocks until every registered `Local` has obtained a fresh outermost
+  // `Snapshot` since the last value has been distributed to it. After that no
+  // reader can observe any value prior to `Update` calls that finished before
+  // this call, so resources referenced only by such values can be released.
+  //
+  // Note that this waits for every reader thread to read, and never returns
+  // if a reader thread holds a `Snapshot` indefinitely or stops reading
+  // without destroying its `Local`.
+  //
+  // Each `Local` publishes the version of the value it has obtained when it
+  // advances to a new one. This acquires `lock_` just once to find the
+  // lagging readers and then sleeps until the last of them advances or is
+  // destroyed, without polling. Readers not waited for pay nothing extra.
+  // Readers waited for never block on this call either, only the last of them
+  // briefly acquires a mutex to wake it up.
+  //
+  // Thread-safe. Concurrent calls are serialized.
+  void Synchronize() LOCKS_EXCLUDED(synchronize_lock_, lock_, grace_lock_) {
+    WaitForReaders();
+  }
+
+  // Asynchronous variant of `Synchronize()`. Calls `callback()` on a
+  // background thread once all readers pass through a grace period as
+  // described above, without blocking the current thread.
+  //
+  // Thread-safe.
+  void CallRcu(std::function<void()> callback) LOCKS_EXCLUDED(callbacks_lock_) {
+    absl::MutexLock mutex(&callbacks_lock_);
+    callbacks_.push_back(std::move(callback));
+    if (!callbacks_thread_.joinable()) {
+      callbacks_thread_ = std::thread(&Rcu::RunCallbacks, this);
+    }
+  }
+
+  // Updates the value in all registered `Local` threads by calling
+  // `mutator(MutableT&)` on the current value in place, without constructing
+  // or destroying any `MutableT` instances.
+  //
+  // The mutated value is then copy-assigned into the spare instance of each
+  // `Local`, which for types such as `std::vector` or `std::map` reuses its
+  // already allocated memory. The spare instance holds an older value, possibly
+  // several updates behind, therefore `mutator` can't be applied to it
+  // directly.
+  //
+  // `mutator` is called while holding a lock that blocks registration of new
+  // `Local` instances, so it should be fast.
+  //
+  // Thread-safe.
+  template <typename F>
+  void UpdateWith(F&& mutator) LOCKS_EXCLUDED(lock_, value_lock_) {
+    LockedUpdate([&]() EXCLUSIVE_LOCKS_REQUIRED(lock_) -> size_t {
+      {
+        absl::MutexLock value_mutex(&value_lock_);
+        std::forward<F>(mutator)(value_);
+        version_++;
+      }
+      size_t locals = 0;
+      threads_.ForEach(
+          [this, &locals](Shard& shard) EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+                LocalRcu& local_rcu = shard.local_rcu;
+                local_rcu.Update().value = value_;
+                local_rcu.Update().version = version_;
+                local_rcu.ForceUpdate();
+                locals++;
+              },
+          [](Shard&) {});
+      WakeWaiters();
+      return locals;
+    });
+  }
+
  private:
+  // Calls `update()` while holding `lock_` and records the time spent waiting
+  // for and holding it in `stats_`. `update` returns the number of `Local`
+  // instances it has distributed a value to.
+  template <typename F>
+  void LockedUpdate(F&& update) LOCKS_EXCLUDED(lock_) {
+    const typename Stats::Time start = Stats::Now();
+    typename Stats::Time locked;
+    typename Stats::Time end;
+    size_t locals;
+    {
+      absl::MutexLock mutex(&lock_);
+      locked = Stats::Now();
+      locals = std::forward<F>(update)();
+      end = Stats::Now();
+    }
+    stats_.RecordUpdate(start, locked, end, locals);
+  }
+
+  // Exchanges `value` with `value_` and increments `version_`.
+  void Swap(MutableT& value) EXCLUSIVE_LOCKS_REQUIRED(lock_)
+      LOCKS_EXCLUDED(value_lock_) {
+    absl::MutexLock mutex(&value_lock_);
+    std::swap(value_, value);
+    version_++;
+  }
+
+  // Distributes `value_` to all registered `Local` threads. The old values
+  // replaced in them are appended to `retired`, to be passed to `Reclaim`
+  // after releasing `lock_`. Returns the number of the `Local` threads.
+  size_t Distribute(std::vector<MutableT>& retired)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    const size_t retired_before = retired.size();
+    threads_.ForEach(
+        [this, &retired](Shard& shard) {
+          Versioned versioned(value_, version_);
+          std::swap(shard.local_rcu.Update(), versioned);
+          shard.local_rcu.ForceUpdate();
+          retired.push_back(std::move(versioned.value));
+        },
+        [](Shard&) {});
+    WakeWaiters();
+    return retired.size() - retired_before;
+  }
+
+  // Wakes up threads in `Local::WaitForUpdate`, if there are any.
+  void WakeWaiters() LOCKS_EXCLUDED(wait_lock_) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) > 0) {
+      absl::MutexLock mutex(&wait_lock_);
+      updated_.SignalAll();
+    }
+  }
+
+  // Implements `Synchronize`. Returns `false` if the wait has been aborted by
+  // the destructor.
+  bool WaitForReaders() LOCKS_EXCLUDED(synchronize_lock_, lock_, grace_lock_) {
+    absl::MutexLock synchronize_mutex(&synchronize_lock_);
+    {
+      absl::MutexLock mutex(&lock_);
+      // All values up to `version_` have been distributed.
+      const uint64_t version = version_;
+      threads_.ForEach(
+          [this, version](Shard& shard) {
+            if (shard.read_version.load() >= version) {
+              return;
+            }
+            // Incremented before publishing `wait_version`, so that a reader
+            // can decrement it only afterwards.
+            lagging_.fetch_add(1);
+            shard.wait_version.store(version);
+            // Pairs with `Local::Advanced()` and `~Local()`: The reader might
+            // have advanced or been destroyed before observing `wait_version`.
+            if (shard.read_version.load() >= version) {
+              ReaderPassed(shard);
+            }
+          },
+          // A `Local` destroyed meanwhile has passed already.
+          [this](Shard& shard) { ReaderPassed(shard); });
+    }
+    absl::MutexLock mutex(&grace_lock_);
+    grace_lock_.Await(absl::Condition(this, &Rcu::ReadersPassedOrAborted));
+    return !abort_grace_;
+  }
+
+  // Called when the reader of `shard` advances while `Synchronize` waits for
+  // it, or when its `Local` is destroyed.
+  void ReaderPassed(Shard& shard) LOCKS_EXCLUDED(grace_lock_) {
+    // Only one of the reader and `WaitForReaders` clears `wait_version`.
+    if (shard.wait_version.load() != 0 &&
+        shard.wait_version.exchange(0) != 0 && lagging_.fetch_sub(1) == 1) {
+      // The last lagging reader. Releasing `grace_lock_` makes `Synchronize`
+      // re-evaluate its condition, so there is nothing to do while holding it.
+      absl::MutexLock mutex(&grace_lock_);
+    }
+  }
+
+  bool ReadersPassedOrAborted() const EXCLUSIVE_LOCKS_REQUIRED(grace_lock_) {
+    return lagging_.load() == 0 || abort_grace_;
+  }
+
+  // Runs callbacks passed to `CallRcu` in batches, each after a grace period.
+  void RunCallbacks() LOCKS_EXCLUDED(callbacks_lock_) {
+    while (true) {
+      std::vector<std::function<void()>> callbacks;
+      {
+        absl::MutexLock mutex(&callbacks_lock_);
+        callbacks_lock_.Await(absl::Condition(this, &Rcu::HasCallbacks));
+        if (stop_) {
+          // The remaining callbacks are run by the destructor.
+          return;
+        }
+        callbacks.swap(callbacks_);
+      }
+      if (!WaitForReaders()) {
+        // Leave the callbacks to the destructor.
+        absl::MutexLock mutex(&callbacks_lock_);
+        callbacks_.insert(callbacks_.end(),
+                          std::make_move_iterator(callbacks.begin()),
+                          std::make_move_iterator(callbacks.end()));
+        return;
+      }
+      for (auto& callback : callbacks) {
+        callback();
+      }
+    }
+  }
+
+  bool HasCallbacks() const EXCLUSIVE_LOCKS_REQUIRED(callbacks_lock_) {
+    return stop_ || !callbacks_.empty();
+  }
+
+  // Takes the buffer for values replaced by `Distribute`, to be given back by
+  // `Reclaim`, so that steady-state updates reuse its capacity instead of
+  // allocating. Concurrent or nested updates, for example from a destructor of
+  // `MutableT`, find the buffer taken and just start with an empty one.
+  std::vector<MutableT> TakeRetiredBuffer() LOCKS_EXCLUDED(retired_lock_) {
+    std::vector<MutableT> buffer;
+    absl::MutexLock mutex(&retired_lock_);
+    buffer.swap(retired_);
+    return buffer;
+  }
+
+  // Passes the values in `retired` to `reclaimer_`, or destroys them if there
+  // is none, and gives the emptied buffer back.
+  void Reclaim(std::vector<MutableT>& retired) LOCKS_EXCLUDED(retired_lock_) {
+    if (reclaimer_ != nullptr && !retired.empty()) {
+      // Moves the values out, keeping the capacity of `retired`.
+      reclaimer_->Retire(
+          std::unique_ptr<Retired>(new RetiredValues<MutableT>(
+              std::vector<MutableT>(std::make_move_iterator(retired.begin()),
+                                    std::make_move_iterator(retired.end())))));
+    }
+    retired.clear();
+    absl::MutexLock mutex(&retired_lock_);
+    if (retired_.capacity() < retired.capacity()) {
+      retired_.swap(retired);
+    }
+  }
+
+  Reclaimer* const reclaimer_;
+  // Serializes distributing values to `threads_`.
   absl::Mutex lock_;
+  // Held only briefly when `value_` is modified, so that `Local` instances can
+  // be registered without waiting for `lock_`.
+  absl::Mutex value_lock_ ACQUIRED_AFTER(lock_);
   // The current value that has been distributed to all thread-`Local`
+  // instances. Modified only while holding both `lock_` and `value_lock_`, so
+  // that it can be read while holding just one of them.
+  MutableT value_;
+  // The version of `value_`. Guarded the same way.
+  uint64_t version_;
+  // Registered thread-`Local` instances. Iterated only while holding `lock_`.
+  Registry threads_;
+  // A value handed over by `UpdateCoalescing` to be distributed, or `nullptr`.
+  std::atomic<MutableT*> pending_;
+  // Set while a thread in `UpdateCoalescing` is distributing `pending_`.
+  std::atomic<bool> distributing_;
+  // Held by `Local::WaitForUpdate` while checking for a new value and waiting
+  // on `updated_`, which is signalled after each distribution.
+  absl::Mutex wait_lock_;
+  absl::CondVar updated_;
+  // The number of threads in `Local::WaitForUpdate`.
+  std::atomic<int> waiters_;
+  // Serializes `Synchronize` calls.
+  absl::Mutex synchronize_lock_ ACQUIRED_BEFORE(lock_);
+  // Held by `Synchronize` while waiting for `lagging_` to reach zero, and
+  // briefly by the reader that decrements it to zero.
+  absl::Mutex grace_lock_;
+  // The number of `Local` instances `Synchronize` is waiting for.
+  std::atomic<int> lagging_;
+  // Set by the destructor to abort `Synchronize` in `callbacks_thread_`.
+  bool abort_grace_ GUARDED_BY(grace_lock_);
+  absl::Mutex callbacks_lock_;
+  // Callbacks passed to `CallRcu` waiting for the next grace period.
+  std::vector<std::function<void()>> callbacks_ GUARDED_BY(callbacks_lock_);
+  // Set by the destructor to stop `callbacks_thread_`.
+  bool stop_ GUARDED_BY(callbacks_lock_);
+  // Started by the first call to `CallRcu` while holding `callbacks_lock_`.
+  std::thread callbacks_thread_;
+  Stats stats_;
+  // Held only briefly to take or give back `retired_`.
+  absl::Mutex retired_lock_;
+  // An empty buffer kept for its capacity, see `TakeRetiredBuffer`.
+  std::vector<MutableT> retired_ GUARDED_BY(retired_lock_);
+  // Must be the last member, see `ThreadLocalLocals`.
+  ThreadLocalLocals<Rcu> thread_locals_;
+
+  friend class RcuBatch;
+};
+
+// Updates multiple `Rcu` instances, possibly of different types, together.
+//
+// All the updates are applied while holding the locks of all the involved
+// `Rcu` instances at once. Therefore no other update of any of them can
+// interleave with the batch: concurrent batches and `Update` calls are
+// serialized, and the final values of all the instances always come from the
+// same batch.
+//
+// Readers that need to observe the values of a batch consistently read them
+// through `Read()` of the same `RcuBatch` instance. Each `Update()` publishes
+// a sequence number, odd while it distributes the values, that `Read()`
+// checks before and after reading, like a sequence lock. Plain reads of the
+// involved `Rcu` instances stay as fast as before, but can observe some of
+// them updated by a batch and some not yet.
+//
+// Thread-compatible (but not thread-safe), except that `Read()` can be called
+// concurrently with any other method.
+class RcuBatch final {
+ public:
+  RcuBatch() : updates_(), sequence_(0) {}
+  RcuBatch(const RcuBatch&) = delete;
+  RcuBatch& operator=(const RcuBatch&) = delete;
+
+  // Adds an update of `rcu` to `value`, to be applied by `Update()`.
+  // If the same `rcu` is added multiple times, the last value replaces the
+  // previous ones, which are never distributed to readers.
+  // `rcu` must outlive the call to `Update()`.
+  template <typename T, typename Stats>
+  RcuBatch& Add(Rcu<T, Stats>& rcu, typename Rcu<T, Stats>::MutableT value) {
+    std::unique_ptr<UpdateBase> update(
+        new TypedUpdate<T, Stats>(rcu, std::move(value)));
+    for (auto& added : updates_) {
+      if (added->rcu() == &rcu) {
+        added = std::move(update);
+        return *this;
+      }
+    }
+    updates_.push_back(std::move(update));
+    return *this;
+  }
+
+  // Applies all the added updates and clears the batch, so that it can be
+  // reused. The previous values are destroyed only after all the locks are
+  // released. Each involved `Rcu` records the update in its `Stats`.
+  //
+  // Thread-safe with respect to other operations on the involved `Rcu`
   // instances.
-  MutableT value_ GUARDED_BY(lock_);
-  // List of registered thread-`Local` instances.
-  absl::flat_hash_set<Local*> threads_ GUARDED_BY(lock_);
+  void Update() {
+    // Lock in a consistent order to avoid deadlocks with concurrent batches.
+    std::sort(updates_.begin(), updates_.end(),
+              [](const std::unique_ptr<UpdateBase>& a,
+                 const std::unique_ptr<UpdateBase>& b) {
+                return a->rcu() < b->rcu();
+              });
+    for (const auto& update : updates_) {
+      update->Lock();
+    }
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    // Pairs with the fence in `Read()`: If it observes any distributed value,
+    // it observes the odd sequence number too.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (const auto& update : updates_) {
+      update->Apply();
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+    for (const auto& update : updates_) {
+      update->Unlock();
+    }
+    for (const auto& update : updates_) {
+      update->Reclaim();
+    }
+    updates_.clear();
+  }
+
+  // Calls `read()` and returns its result, calling it again until no
+  // `Update()` of this batch has distributed its values during the call.
+  // Therefore the values `read` obtains from the `Rcu` instances updated by
+  // this batch all come from the same batch, or from `Update` calls of the
+  // individual instances since then.
+  //
+  // `read` should obtain outermost `Snapshot`s from the `Local` instances of
+  // the current thread, so that each call advances them to the latest values,
+  // and its result shouldn't refer to them. It's called at least once and
+  // retried only while batches are being applied concurrently.
+  //
+  // Thread-safe, lock-free.
+  template <typename F>
+  auto Read(F&& read) const -> typename std::decay<decltype(read())>::type {
+    while (true) {
+      const uint64_t before = sequence_.load(std::memory_order_acquire);
+      if (before % 2 != 0) {
+        // `Update()` is distributing the values.
+        std::this_thread::yield();
+        continue;
+      }
+      typename std::decay<decltype(read())>::type result = read();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == before) {
+        return result;
+      }
+    }
+  }
+
+ private:
+  class UpdateBase {
+   public:
+    virtual ~UpdateBase() = default;
+
+    // The updated `Rcu`, for identifying duplicate updates and ordering locks.
+    virtual const void* rcu() const = 0;
+    // Acquire and release the lock of `rcu()`, recording the time spent
+    // waiting for and holding it.
+    virtual void Lock() = 0;
+    virtual void Unlock() = 0;
+    // Swaps the held value with the current value of the `Rcu` and
+    // distributes it. Requires `Lock()` to be held.
+    virtual void Apply() = 0;
+    // Reclaims the old values replaced by `Apply()`. Requires `Lock()` not to
+    // be held.
+    virtual void Reclaim() = 0;
+  };
+
+  template <typename T, typename Stats>
+  class TypedUpdate final : public UpdateBase {
+   public:
+    TypedUpdate(Rcu<T, Stats>& rcu, typename Rcu<T, Stats>::MutableT value)
+        : rcu_(rcu),
+          value_(std::move(value)),
+          retired_(),
+          start_(),
+          locked_(),
+          locals_(0) {}
+
+    const void* rcu() const override { return &rcu_; }
+    void Lock() override EXCLUSIVE_LOCK_FUNCTION(rcu_.lock_) {
+      start_ = Stats::Now();
+      rcu_.lock_.Lock();
+      locked_ = Stats::Now();
+    }
+    void Unlock() override UNLOCK_FUNCTION(rcu_.lock_) {
+      const typename Stats::Time end = Stats::Now();
+      rcu_.lock_.Unlock();
+      rcu_.stats_.RecordUpdate(start_, locked_, end, locals_);
+    }
+    void Apply() override EXCLUSIVE_LOCKS_REQUIRED(rcu_.lock_) {
+      rcu_.Swap(value_);
+      retired_ = rcu_.TakeRetiredBuffer();
+      locals_ = rcu_.Distribute(retired_);
+    }
+    void Reclaim() override { rcu_.Reclaim(retired_); }
+
+   private:
+    Rcu<T, Stats>& rcu_;
+    typename Rcu<T, Stats>::MutableT value_;
+    std::vector<typename Rcu<T, Stats>::MutableT> retired_;
+    typename Stats::Time start_;
+    typename Stats::Time locked_;
+    // The number of `Local` instances `Apply()` has distributed the value to.
+    size_t locals_;
+  };
+
+  std::vector<std::unique_ptr<UpdateBase>> updates_;
+  // Incremented by `Update()` before and after distributing the values.
+  std::atomic<uint64_t> sequence_;
 };
 
 }  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RCU_H
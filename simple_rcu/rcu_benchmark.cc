@@ -12,31 +12,46 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <deque>
 #include <thread>
 
 #include "benchmark/benchmark.h"
+#include "simple_rcu/hierarchical_rcu.h"
+#include "simple_rcu/numa.h"
 #include "simple_rcu/rcu.h"
+#include "simple_rcu/seqlock_rcu.h"
+#include "simple_rcu/shared_rcu.h"
 
 namespace simple_rcu {
 namespace {
 
-static void BM_Reads(benchmark::State& state) {
+// A 256-byte plain configuration struct.
+struct Config {
+  Config(int_fast32_t value = 0) { fields.fill(value); }
+
+  std::array<int64_t, 32> fields;
+};
+
+template <typename R>
+static void Reads(benchmark::State& state) {
   std::atomic<bool> finished(false);
-  static Rcu<int_fast32_t> rcu;
+  static R rcu;
   std::deque<std::thread> updater_threads;
   if (state.thread_index() == 0) {
     for (int i = 0; i < state.range(0); i++) {
       updater_threads.emplace_back([&]() {
         int_fast32_t updates = 0;
         while (!finished.load()) {
-          benchmark::DoNotOptimize(rcu.Update(updates++));
+          rcu.Update(updates++);
+          benchmark::ClobberMemory();
         }
       });
     }
   }
-  static thread_local Rcu<int_fast32_t>::Local reader(rcu);
+  static thread_local typename R::Local reader(rcu);
   for (auto _ : state) {
     benchmark::DoNotOptimize(*reader.Read());
     benchmark::ClobberMemory();
@@ -46,9 +61,125 @@ static void BM_Reads(benchmark::State& state) {
     thread.join();
   }
 }
+
+template <typename R>
+static void Updates(benchmark::State& state) {
+  std::atomic<bool> finished(false);
+  static R rcu;
+  std::deque<std::thread> reader_threads;
+  if (state.thread_index() == 0) {
+    for (int i = 0; i < state.range(0); i++) {
+      reader_threads.emplace_back([&]() {
+        static thread_local typename R::Local reader(rcu);
+        while (!finished.load()) {
+          benchmark::DoNotOptimize(*reader.Read());
+        }
+      });
+    }
+  }
+  int_fast32_t updates = 0;
+  for (auto _ : state) {
+    rcu.Update(++updates);
+    benchmark::ClobberMemory();
+  }
+  finished.store(true);
+  for (auto& thread : reader_threads) {
+    thread.join();
+  }
+}
+
+// Like `Updates`, but the reader threads are spread evenly over NUMA nodes and
+// pinned to them.
+template <typename R>
+static void PinnedUpdates(benchmark::State& state) {
+  static const NumaTopology topology = NumaTopology::FromSystem();
+  std::atomic<bool> finished(false);
+  static R rcu;
+  std::deque<std::thread> reader_threads;
+  if (state.thread_index() == 0) {
+    for (int i = 0; i < state.range(0); i++) {
+      reader_threads.emplace_back([&, i]() {
+        PinCurrentThread(topology.cpus(i % topology.nodes()));
+        static thread_local typename R::Local reader(rcu);
+        while (!finished.load()) {
+          benchmark::DoNotOptimize(*reader.Read());
+        }
+      });
+    }
+  }
+  int_fast32_t updates = 0;
+  for (auto _ : state) {
+    rcu.Update(++updates);
+    benchmark::ClobberMemory();
+  }
+  finished.store(true);
+  for (auto& thread : reader_threads) {
+    thread.join();
+  }
+  state.counters["nodes"] = topology.nodes();
+}
+
+static void BM_Reads(benchmark::State& state) {
+  Reads<Rcu<int_fast32_t>>(state);
+}
 BENCHMARK(BM_Reads)->ThreadRange(1, 3)->Arg(1)->Arg(4);
 
 static void BM_Updates(benchmark::State& state) {
+  Updates<Rcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_Updates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SharedReads(benchmark::State& state) {
+  Reads<SharedRcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_SharedReads)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SharedUpdates(benchmark::State& state) {
+  Updates<SharedRcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_SharedUpdates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SeqlockReads(benchmark::State& state) {
+  Reads<SeqlockRcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_SeqlockReads)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SeqlockUpdates(benchmark::State& state) {
+  Updates<SeqlockRcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_SeqlockUpdates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_ConfigReads(benchmark::State& state) {
+  Reads<Rcu<Config>>(state);
+}
+BENCHMARK(BM_ConfigReads)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_ConfigUpdates(benchmark::State& state) {
+  Updates<Rcu<Config>>(state);
+}
+BENCHMARK(BM_ConfigUpdates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SeqlockConfigReads(benchmark::State& state) {
+  Reads<SeqlockRcu<Config>>(state);
+}
+BENCHMARK(BM_SeqlockConfigReads)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_SeqlockConfigUpdates(benchmark::State& state) {
+  Updates<SeqlockRcu<Config>>(state);
+}
+BENCHMARK(BM_SeqlockConfigUpdates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+
+static void BM_PinnedUpdates(benchmark::State& state) {
+  PinnedUpdates<Rcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_PinnedUpdates)->Arg(1)->Arg(4);
+
+static void BM_HierarchicalUpdates(benchmark::State& state) {
+  PinnedUpdates<HierarchicalRcu<int_fast32_t>>(state);
+}
+BENCHMARK(BM_HierarchicalUpdates)->Arg(1)->Arg(4);
+
+static void BM_UpdatesCoalescing(benchmark::State& state) {
   std::atomic<bool> finished(false);
   static Rcu<int_fast32_t> rcu;
   std::deque<std::thread> reader_threads;
@@ -64,7 +195,7 @@ static void BM_Updates(benchmark::State& state) {
   }
   int_fast32_t updates = 0;
   for (auto _ : state) {
-    benchmark::DoNotOptimize(rcu.Update(++updates));
+    rcu.UpdateCoalescing(++updates);
     benchmark::ClobberMemory();
   }
   finished.store(true);
@@ -72,7 +203,7 @@ static void BM_Updates(benchmark::State& state) {
     thread.join();
   }
 }
-BENCHMARK(BM_Updates)->ThreadRange(1, 3)->Arg(1)->Arg(4);
+BENCHMARK(BM_UpdatesCoalescing)->ThreadRange(1, 3)->Arg(1)->Arg(4);
 
 }  // namespace
 }  // namespace simple_rcu
@@ -0,0 +1,232 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RCU_MAP_H
+#define _SIMPLE_RCU_RCU_MAP_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/numeric/int128.h"
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/rcu.h"
+#include "simple_rcu/reclaimer.h"
+
+namespace simple_rcu {
+
+// Concurrent hash map with lock-free reads, built on `Rcu`.
+//
+// The map is split into a fixed number of shards, each an immutable
+// `absl::flat_hash_map` shared by pointer. An update copies just the affected
+// shard and the vector of pointers to the shards, and publishes the new
+// version by `Rcu::Update`. Therefore changing one key costs
+// O(size() / shards + shards) instead of copying the whole map. `SetMany`
+// applies many changes at once, copying each affected shard just once. Replaced
+// shards are destroyed once no reader references them, by the `Reclaimer`
+// passed to the constructor, if any.
+//
+// Readers `Find()` keys in a `Snapshot`, which is a consistent view of the
+// whole map.
+template <typename K, typename V, typename Hash = absl::Hash<K>,
+          typename Eq = std::equal_to<K>>
+class RcuMap final {
+ public:
+  using Shard = absl::flat_hash_map<K, V, Hash, Eq>;
+
+ private:
+  struct Table {
+    std::vector<std::shared_ptr<const Shard>> shards;
+    // The total number of entries in `shards`.
+    size_t size;
+  };
+  using TableRcu = Rcu<std::shared_ptr<const Table>>;
+
+ public:
+  // Holds a read reference to a version of the map for the current thread.
+  // The version is guaranteed to be stable during the lifetime of `Snapshot`.
+  // Callers are expected to limit the lifetime of `Snapshot` to as short as
+  // possible.
+  // Thread-compatible (but not thread-safe), reentrant.
+  class Snapshot final {
+   public:
+    // Returns a pointer to the value of `key`, or `nullptr` if there is none.
+    // The pointer is valid during the lifetime of the `Snapshot`.
+    const V* Find(const K& key) const {
+      const Shard& shard = *table().shards[map_.ShardIndex(key)];
+      auto it = shard.find(key);
+      return it == shard.end() ? nullptr : &it->second;
+    }
+
+    size_t size() const noexcept { return table().size; }
+
+   private:
+    Snapshot(const RcuMap& map, typename TableRcu::Snapshot snapshot)
+        : map_(map), snapshot_(std::move(snapshot)) {}
+
+    const Table& table() const noexcept { return **snapshot_; }
+
+    const RcuMap& map_;
+    typename TableRcu::Snapshot snapshot_;
+
+    friend class RcuMap;
+  };
+
+  // Interface to the map local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the `Read()`
+  // method is only thread-compatible. Callers are expected to construct a
+  // separate `Local` instance for each reader thread.
+  class Local final {
+   public:
+    // Thread-safe.
+    explicit Local(RcuMap& map) : map_(map), local_(map.rcu_) {}
+
+    // Obtains a read snapshot to the current version of the map.
+    // This is a very fast, lock-free and atomic operation.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Read() noexcept { return Snapshot(map_, local_.Read()); }
+
+   private:
+    RcuMap& map_;
+    typename TableRcu::Local local_;
+  };
+
+  // Constructs an empty map with `shards` shards, which must be positive.
+  // If `reclaimer` is given, replaced shards are passed to it, see `Rcu`.
+  explicit RcuMap(size_t shards = 64, Reclaimer* reclaimer = nullptr,
+                  const Hash& hash = Hash())
+      : hash_(hash),
+        shard_count_(shards),
+        reclaimer_(reclaimer),
+        lock_(),
+        current_(EmptyTable(shards)),
+        rcu_(current_, reclaimer) {
+    assert(shards > 0);
+  }
+
+  size_t shards() const noexcept { return shard_count_; }
+
+  // Sets the value of `key` to `value`, inserting it if needed.
+  //
+  // Thread-safe. Concurrent updates are serialized.
+  void Set(K key, V value) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    const size_t index = ShardIndex(key);
+    std::shared_ptr<Table> table = std::make_shared<Table>(*current_);
+    std::shared_ptr<Shard> shard =
+        std::make_shared<Shard>(*current_->shards[index]);
+    if (shard->insert_or_assign(std::move(key), std::move(value)).second) {
+      table->size++;
+    }
+    table->shards[index] = std::move(shard);
+    Publish(std::move(table));
+  }
+
+  // Sets the values of all `entries`, like `Set` for each of them, but
+  // publishes them together in a single update that copies each affected
+  // shard just once. If a key is present multiple times, the last value wins.
+  // Use it to fill a large map, which would otherwise be copied
+  // O(entries / shards) times.
+  //
+  // Thread-safe. Concurrent updates are serialized.
+  void SetMany(std::vector<std::pair<K, V>> entries) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    std::shared_ptr<Table> table = std::make_shared<Table>(*current_);
+    // Copies of the shards modified so far.
+    std::vector<std::shared_ptr<Shard>> copies(shard_count_);
+    for (auto& entry : entries) {
+      const size_t index = ShardIndex(entry.first);
+      if (copies[index] == nullptr) {
+        copies[index] = std::make_shared<Shard>(*current_->shards[index]);
+        table->shards[index] = copies[index];
+      }
+      if (copies[index]
+              ->insert_or_assign(std::move(entry.first),
+                                 std::move(entry.second))
+              .second) {
+        table->size++;
+      }
+    }
+    Publish(std::move(table));
+  }
+
+  // Removes `key` from the map. Returns `false` if it wasn't there.
+  //
+  // Thread-safe. Concurrent updates are serialized.
+  bool Erase(const K& key) LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    const size_t index = ShardIndex(key);
+    if (current_->shards[index]->count(key) == 0) {
+      return false;
+    }
+    std::shared_ptr<Table> table = std::make_shared<Table>(*current_);
+    std::shared_ptr<Shard> shard =
+        std::make_shared<Shard>(*current_->shards[index]);
+    shard->erase(key);
+    table->shards[index] = std::move(shard);
+    table->size--;
+    Publish(std::move(table));
+    return true;
+  }
+
+ private:
+  static std::shared_ptr<const Table> EmptyTable(size_t shards) {
+    std::shared_ptr<Table> table = std::make_shared<Table>();
+    const std::shared_ptr<const Shard> empty = std::make_shared<Shard>();
+    table->shards.assign(shards, empty);
+    table->size = 0;
+    return table;
+  }
+
+  // Uses the high bits of the hash, since `Shard` uses its low bits. Otherwise
+  // all keys in a shard would share some of them, slowing down lookups.
+  size_t ShardIndex(const K& key) const {
+    return static_cast<size_t>(absl::Uint128High64(
+        absl::uint128(static_cast<uint64_t>(hash_(key))) * shard_count_));
+  }
+
+  // Publishes `table` as the new version of the map. The previous table is
+  // passed to `reclaimer_`, if any, as it might hold the last references to
+  // the replaced shards.
+  void Publish(std::shared_ptr<const Table> table)
+      EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    current_ = table;
+    std::shared_ptr<const Table> previous = rcu_.Update(std::move(table));
+    if (reclaimer_ != nullptr) {
+      std::vector<std::shared_ptr<const Table>> retired;
+      retired.push_back(std::move(previous));
+      reclaimer_->Retire(std::unique_ptr<Retired>(
+          new RetiredValues<std::shared_ptr<const Table>>(std::move(retired))));
+    }
+  }
+
+  const Hash hash_;
+  const size_t shard_count_;
+  Reclaimer* const reclaimer_;
+  // Serializes updates.
+  absl::Mutex lock_;
+  // The last published table.
+  std::shared_ptr<const Table> current_ GUARDED_BY(lock_);
+  TableRcu rcu_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RCU_MAP_H
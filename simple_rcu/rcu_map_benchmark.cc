@@ -0,0 +1,63 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/rcu_map.h"
+
+namespace simple_rcu {
+namespace {
+
+// Sets keys `0..keys-1` in a single update.
+void Fill(RcuMap<int64_t, int64_t>& map, int64_t keys) {
+  std::vector<std::pair<int64_t, int64_t>> entries;
+  entries.reserve(keys);
+  for (int64_t i = 0; i < keys; i++) {
+    entries.emplace_back(i, i);
+  }
+  map.SetMany(std::move(entries));
+}
+
+// Updates a single key of a map with 64K entries split into `state.range(0)`
+// shards. With 1 shard this is equivalent to copying the whole map.
+static void BM_Set(benchmark::State& state) {
+  static constexpr int64_t kKeys = 1 << 16;
+  RcuMap<int64_t, int64_t> map(static_cast<size_t>(state.range(0)));
+  Fill(map, kKeys);
+  int64_t key = 0;
+  for (auto _ : state) {
+    map.Set(key, key);
+    key = (key + 1) % kKeys;
+  }
+}
+BENCHMARK(BM_Set)->Arg(1)->Arg(64)->Arg(1024);
+
+static void BM_Find(benchmark::State& state) {
+  static constexpr int64_t kKeys = 1 << 16;
+  RcuMap<int64_t, int64_t> map;
+  Fill(map, kKeys);
+  RcuMap<int64_t, int64_t>::Local local(map);
+  int64_t key = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(local.Read().Find(key));
+    key = (key + 1) % kKeys;
+  }
+}
+BENCHMARK(BM_Find);
+
+}  // namespace
+}  // namespace simple_rcu
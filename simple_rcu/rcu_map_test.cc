@@ -0,0 +1,162 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/rcu_map.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/reclaimer.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(RcuMapTest, SetFindAndErase) {
+  RcuMap<std::string, int> map(/*shards=*/4);
+  RcuMap<std::string, int>::Local local(map);
+  EXPECT_EQ(local.Read().Find("a"), nullptr);
+  map.Set("a", 1);
+  map.Set("b", 2);
+  map.Set("a", 3);
+  {
+    auto snapshot = local.Read();
+    ASSERT_NE(snapshot.Find("a"), nullptr);
+    EXPECT_EQ(*snapshot.Find("a"), 3);
+    ASSERT_NE(snapshot.Find("b"), nullptr);
+    EXPECT_EQ(*snapshot.Find("b"), 2);
+    EXPECT_EQ(snapshot.size(), 2);
+  }
+  EXPECT_TRUE(map.Erase("a"));
+  EXPECT_FALSE(map.Erase("a"));
+  auto snapshot = local.Read();
+  EXPECT_EQ(snapshot.Find("a"), nullptr);
+  EXPECT_EQ(snapshot.size(), 1);
+}
+
+TEST(RcuMapTest, SnapshotIsStable) {
+  RcuMap<int, int> map;
+  RcuMap<int, int>::Local local(map);
+  map.Set(1, 1);
+  auto snapshot = local.Read();
+  map.Set(1, 2);
+  map.Set(2, 2);
+  EXPECT_EQ(*snapshot.Find(1), 1);
+  EXPECT_EQ(snapshot.Find(2), nullptr);
+  EXPECT_EQ(*local.Read().Find(1), 1) << "Nested snapshots keep the version";
+}
+
+// Counts copies, so that tests can check how much of the map is copied.
+struct Counted {
+  static std::atomic<int> copies;
+
+  Counted() = default;
+  Counted(const Counted&) { copies++; }
+  Counted& operator=(const Counted&) {
+    copies++;
+    return *this;
+  }
+};
+std::atomic<int> Counted::copies(0);
+
+TEST(RcuMapTest, UpdateCopiesOneShard) {
+  static constexpr int kKeys = 1000;
+  RcuMap<int, Counted> map(/*shards=*/16);
+  for (int i = 0; i < kKeys; i++) {
+    map.Set(i, Counted());
+  }
+  Counted::copies = 0;
+  map.Set(0, Counted());
+  EXPECT_LT(Counted::copies.load(), kKeys / 4)
+      << "Only the shard containing the key should have been copied";
+}
+
+TEST(RcuMapTest, SetManyCopiesEachShardOnce) {
+  static constexpr int kKeys = 1000;
+  RcuMap<int, Counted> map(/*shards=*/16);
+  std::vector<std::pair<int, Counted>> entries(kKeys);
+  for (int i = 0; i < kKeys; i++) {
+    entries[i].first = i;
+  }
+  map.SetMany(std::move(entries));
+  RcuMap<int, Counted>::Local local(map);
+  EXPECT_EQ(local.Read().size(), kKeys);
+  Counted::copies = 0;
+  map.SetMany({{0, Counted()}, {1, Counted()}, {0, Counted()}});
+  EXPECT_LT(Counted::copies.load(), kKeys / 4)
+      << "Only the shards containing the keys should have been copied";
+  EXPECT_EQ(local.Read().size(), kKeys) << "No key has been inserted";
+}
+
+// Keeps all retired values until destroyed.
+class KeepingReclaimer final : public Reclaimer {
+ public:
+  void Retire(std::unique_ptr<Retired> retired) override {
+    retired_.push_back(std::move(retired));
+  }
+
+  size_t retired() const { return retired_.size(); }
+
+ private:
+  std::vector<std::unique_ptr<Retired>> retired_;
+};
+
+TEST(RcuMapTest, PassesReplacedTablesToReclaimer) {
+  KeepingReclaimer reclaimer;
+  RcuMap<int, int> map(/*shards=*/4, &reclaimer);
+  map.Set(1, 1);
+  map.Set(1, 2);
+  EXPECT_TRUE(map.Erase(1));
+  EXPECT_EQ(reclaimer.retired(), 3)
+      << "Each update must retire the previous table";
+}
+
+TEST(RcuMapTest, ConcurrentReadsAndUpdates) {
+  static constexpr int kKeys = 100;
+  BackgroundReclaimer reclaimer;
+  RcuMap<int, int> map(/*shards=*/8, &reclaimer);
+  std::atomic<bool> finished(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 3; i++) {
+    readers.emplace_back([&]() {
+      RcuMap<int, int>::Local local(map);
+      while (!finished.load()) {
+        auto snapshot = local.Read();
+        for (int key = 0; key < kKeys; key++) {
+          const int* value = snapshot.Find(key);
+          if (value != nullptr) {
+            ASSERT_EQ(*value % kKeys, key);
+          }
+        }
+      }
+    });
+  }
+  for (int round = 0; round < 10; round++) {
+    for (int key = 0; key < kKeys; key++) {
+      map.Set(key, round * kKeys + key);
+    }
+  }
+  finished.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  RcuMap<int, int>::Local local(map);
+  EXPECT_EQ(local.Read().size(), kKeys);
+  EXPECT_EQ(*local.Read().Find(7), 9 * kKeys + 7);
+}
+
+}  // namespace
+}  // namespace simple_rcu
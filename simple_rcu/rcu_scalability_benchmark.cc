@@ -0,0 +1,301 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Scalability sweep of `Rcu` reads and updates over the number of cores.
+//
+// Each benchmark runs from 1 to all CPUs of the machine, with threads either
+// unpinned, pinned to individual CPUs or pinned to NUMA nodes, and reports
+// per-operation latency quantiles as counters `p50_ns`, `p99_ns` and
+// `p999_ns`. The samples include the cost of reading the clock, which is
+// reported as `clock_ns`. Run with
+//
+//   --benchmark_out=scalability.json --benchmark_out_format=json
+//
+// to get results that can be compared across releases, for example by
+// `tools/compare.py` of Google Benchmark.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "benchmark/benchmark.h"
+#include "simple_rcu/numa.h"
+#include "simple_rcu/quantile_sketch.h"
+#include "simple_rcu/rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+enum PinMode : int64_t {
+  kUnpinned = 0,
+  // Thread `i` is pinned to the `i`-th CPU (modulo their number).
+  kPinCpus = 1,
+  // Thread `i` is pinned to all CPUs of the `i`-th NUMA node (modulo their
+  // number).
+  kPinNodes = 2,
+};
+
+const NumaTopology& Topology() {
+  static const NumaTopology topology = NumaTopology::FromSystem();
+  return topology;
+}
+
+const std::vector<int>& AllCpus() {
+  static const std::vector<int> cpus = []() {
+    std::vector<int> result;
+    for (int node = 0; node < Topology().nodes(); node++) {
+      const std::vector<int>& node_cpus = Topology().cpus(node);
+      result.insert(result.end(), node_cpus.begin(), node_cpus.end());
+    }
+    return result;
+  }();
+  return cpus;
+}
+
+// Pins the current thread, which is the `slot`-th thread of a benchmark run,
+// according to `mode`.
+void Pin(int64_t mode, int slot) {
+  if (mode == kPinCpus) {
+    PinCurrentThread({AllCpus()[slot % AllCpus().size()]});
+  } else if (mode == kPinNodes) {
+    PinCurrentThread(Topology().cpus(slot % Topology().nodes()));
+  }
+}
+
+// Benchmark thread 0 is the main thread, which runs also subsequent
+// benchmarks, so it must be unpinned again.
+void Unpin(int64_t mode) {
+  if (mode != kUnpinned) {
+    PinCurrentThread(AllCpus());
+  }
+}
+
+// Merges the latency sketches of all threads of a benchmark run, which is
+// reported by thread 0.
+class Latencies final {
+ public:
+  Latencies() : lock_(), merged_(), merged_threads_(0), threads_(0) {}
+
+  // Called by each thread of a benchmark run after its measuring loop. The
+  // call of thread 0 waits for all the others.
+  void Report(benchmark::State& state, const QuantileSketch<>& sketch)
+      LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    merged_ += sketch;
+    merged_threads_++;
+    if (state.thread_index() != 0) {
+      return;
+    }
+    threads_ = state.threads();
+    lock_.Await(absl::Condition(this, &Latencies::AllMerged));
+    state.counters["p50_ns"] = merged_.Quantile(0.5);
+    state.counters["p99_ns"] = merged_.Quantile(0.99);
+    state.counters["p999_ns"] = merged_.Quantile(0.999);
+    // Threads of the next run start only after this one has finished.
+    merged_ = QuantileSketch<>();
+    merged_threads_ = 0;
+  }
+
+ private:
+  bool AllMerged() const EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return merged_threads_ == threads_;
+  }
+
+  absl::Mutex lock_;
+  QuantileSketch<> merged_ GUARDED_BY(lock_);
+  int merged_threads_ GUARDED_BY(lock_);
+  int threads_ GUARDED_BY(lock_);
+};
+
+Latencies latencies;
+
+// Runs `state.range(0)` background threads calling `operation` in a loop
+// until destroyed. Each is pinned as the `first_slot + i`-th thread.
+class BackgroundThreads final {
+ public:
+  template <typename F>
+  BackgroundThreads(benchmark::State& state, int first_slot, F operation)
+      : finished_(false), threads_() {
+    const int64_t mode = state.range(1);
+    for (int i = 0; i < state.range(0); i++) {
+      threads_.emplace_back([this, mode, first_slot, i, operation]() mutable {
+        Pin(mode, first_slot + i);
+        operation(finished_);
+      });
+    }
+  }
+  ~BackgroundThreads() {
+    finished_.store(true);
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+ private:
+  std::atomic<bool> finished_;
+  std::deque<std::thread> threads_;
+};
+
+double ElapsedNanos(std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end) {
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// The median cost of reading the clock, which is included in each sample
+// recorded by `Measure`.
+double ClockNanos() {
+  static const double clock_ns = []() {
+    QuantileSketch<> sketch;
+    for (int i = 0; i < 10000; i++) {
+      const auto start = std::chrono::steady_clock::now();
+      const auto end = std::chrono::steady_clock::now();
+      sketch.Record(ElapsedNanos(start, end));
+    }
+    return sketch.Quantile(0.5);
+  }();
+  return clock_ns;
+}
+
+// Calls `operation` once per iteration, recording its latency in nanoseconds
+// into `sketch`. Each operation is timed separately, so that the quantiles
+// reflect individual slow operations rather than averages. The samples
+// include the cost of reading the clock, which is reported as `clock_ns`.
+template <typename F>
+void Measure(benchmark::State& state, QuantileSketch<>& sketch, F operation) {
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    operation();
+    const auto end = std::chrono::steady_clock::now();
+    sketch.Record(ElapsedNanos(start, end));
+  }
+  state.SetItemsProcessed(state.iterations());
+  // Counters of all threads are summed up, so only one thread reports it.
+  if (state.thread_index() == 0) {
+    state.counters["clock_ns"] = ClockNanos();
+  }
+}
+
+Rcu<int_fast32_t> rcu;
+
+// Measured readers are the benchmark threads, with `state.range(0)` updaters
+// in the background.
+void Reads(benchmark::State& state) {
+  const int64_t mode = state.range(1);
+  Pin(mode, state.thread_index());
+  std::unique_ptr<BackgroundThreads> updaters;
+  if (state.thread_index() == 0) {
+    updaters.reset(new BackgroundThreads(
+        state, state.threads(), [](const std::atomic<bool>& finished) {
+          int_fast32_t updates = 0;
+          while (!finished.load()) {
+            rcu.Update(updates++);
+          }
+        }));
+  }
+  QuantileSketch<> sketch;
+  {
+    Rcu<int_fast32_t>::Local reader(rcu);
+    Measure(state, sketch,
+                [&reader]() { benchmark::DoNotOptimize(*reader.Read()); });
+  }
+  updaters.reset();
+  latencies.Report(state, sketch);
+  Unpin(mode);
+}
+
+// Measured updaters are the benchmark threads, with `state.range(0)` readers
+// in the background.
+void Updates(benchmark::State& state) {
+  const int64_t mode = state.range(1);
+  Pin(mode, state.thread_index());
+  std::unique_ptr<BackgroundThreads> readers;
+  if (state.thread_index() == 0) {
+    readers.reset(new BackgroundThreads(
+        state, state.threads(), [](const std::atomic<bool>& finished) {
+          Rcu<int_fast32_t>::Local reader(rcu);
+          while (!finished.load()) {
+            benchmark::DoNotOptimize(*reader.Read());
+          }
+        }));
+  }
+  QuantileSketch<> sketch;
+  int_fast32_t updates = 0;
+  Measure(state, sketch, [&updates]() { rcu.Update(++updates); });
+  readers.reset();
+  latencies.Report(state, sketch);
+  Unpin(mode);
+}
+
+// 1, 2, 4, ... up to the number of CPUs, which is always included.
+std::vector<int> CoreCounts() {
+  const int cpus = static_cast<int>(AllCpus().size());
+  std::vector<int> counts;
+  for (int count = 1; count < cpus; count *= 2) {
+    counts.push_back(count);
+  }
+  counts.push_back(cpus);
+  return counts;
+}
+
+// Sweeps the measured threads with a single background thread.
+void SweepThreads(benchmark::internal::Benchmark* benchmark) {
+  for (int threads : CoreCounts()) {
+    benchmark->Threads(threads);
+  }
+  for (int64_t mode : {kUnpinned, kPinCpus, kPinNodes}) {
+    benchmark->Args({1, mode});
+  }
+}
+
+// Sweeps the background threads with a single measured thread. For updates
+// this is the fan-out of `Rcu::Update` to reader threads.
+void SweepBackground(benchmark::internal::Benchmark* benchmark) {
+  for (int threads : CoreCounts()) {
+    for (int64_t mode : {kUnpinned, kPinCpus, kPinNodes}) {
+      benchmark->Args({threads, mode});
+    }
+  }
+}
+
+static void BM_ScaledReads(benchmark::State& state) { Reads(state); }
+BENCHMARK(BM_ScaledReads)
+    ->ArgNames({"updaters", "pin"})
+    ->Apply(SweepThreads)
+    ->UseRealTime();
+
+static void BM_ReadsWithUpdaters(benchmark::State& state) { Reads(state); }
+BENCHMARK(BM_ReadsWithUpdaters)
+    ->ArgNames({"updaters", "pin"})
+    ->Apply(SweepBackground)
+    ->UseRealTime();
+
+static void BM_ScaledUpdates(benchmark::State& state) { Updates(state); }
+BENCHMARK(BM_ScaledUpdates)
+    ->ArgNames({"readers", "pin"})
+    ->Apply(SweepThreads)
+    ->UseRealTime();
+
+static void BM_UpdateFanOut(benchmark::State& state) { Updates(state); }
+BENCHMARK(BM_UpdateFanOut)
+    ->ArgNames({"readers", "pin"})
+    ->Apply(SweepBackground)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace simple_rcu
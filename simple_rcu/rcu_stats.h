@@ -0,0 +1,199 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RCU_STATS_H
+#define _SIMPLE_RCU_RCU_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "simple_rcu/quantile_sketch.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+
+// Statistics policy for `Rcu<T, RcuStats>` and `ReverseRcu<T, RcuStats>` that
+// records latency distributions of updates and collections, the numbers of
+// `Local` instances they visit and how often readers obtain new values.
+//
+// Samples are recorded through thread-local `ReverseRcu` instances, and reads
+// through one registered by each `Rcu::Local`, so that recording them doesn't
+// contend between threads nor with the instrumented RCU. As usual with
+// `ReverseRcu`, each thread's last sample is only collected after its next
+// one.
+//
+// Thread-safe.
+class RcuStats final {
+ private:
+  struct Reads {
+    Reads() : Reads(0, 0) {}
+    Reads(uint64_t total_, uint64_t stale_) : total(total_), stale(stale_) {}
+
+    Reads& operator+=(const Reads& other) {
+      total += other.total;
+      stale += other.stale;
+      return *this;
+    }
+
+    uint64_t total;
+    uint64_t stale;
+  };
+
+ public:
+  using Time = absl::Time;
+
+  // Records reads of a single `Rcu::Local`. Registers with a `ReverseRcu` on
+  // construction, so that recording reads doesn't need `ThreadLocal()`, which
+  // can allocate on first use.
+  class Reader final {
+   public:
+    explicit Reader(RcuStats& stats) : local_(stats.reads_) {}
+
+   private:
+    ReverseRcu<Reads>::Local local_;
+
+    friend class RcuStats;
+  };
+
+  // Statistics recorded since the construction. Durations are in seconds.
+  struct Totals {
+    Totals()
+        : update_lock_wait(),
+          update_lock_held(),
+          update_locals(),
+          collect_lock_wait(),
+          collect_latency(),
+          collect_locals(),
+          reads(0),
+          stale_reads(0),
+          locals(0) {}
+
+    // The fraction of outermost `Snapshot`s that kept the previous value, or 0
+    // if there have been none.
+    double stale_read_ratio() const noexcept {
+      return reads == 0 ? 0 : static_cast<double>(stale_reads) / reads;
+    }
+
+    // How long each update waited for the `Rcu` lock.
+    QuantileSketch<> update_lock_wait;
+    // How long each update held the `Rcu` lock.
+    QuantileSketch<> update_lock_held;
+    // The number of `Local` instances each update distributed a value to.
+    QuantileSketch<> update_locals;
+    // How long each `Collect` waited for the `ReverseRcu` lock.
+    QuantileSketch<> collect_lock_wait;
+    // How long each `Collect` took from its start until its values have been
+    // combined.
+    QuantileSketch<> collect_latency;
+    // The number of `Local` instances each `Collect` visited.
+    QuantileSketch<> collect_locals;
+    // The number of outermost `Snapshot`s, and the number of those that
+    // didn't obtain a new value.
+    uint64_t reads;
+    uint64_t stale_reads;
+    // The number of registered `Local` instances seen by the last update or
+    // `Collect`.
+    size_t locals;
+  };
+
+  RcuStats()
+      : updates_(), reads_(), collects_(), locals_(0), lock_(), totals_() {}
+
+  static Time Now() { return absl::Now(); }
+
+  void RecordUpdate(Time start, Time locked, Time end, size_t locals) {
+    locals_.store(locals, std::memory_order_relaxed);
+    auto sample = updates_.ThreadLocal().Write();
+    sample->lock_wait.Record(absl::ToDoubleSeconds(locked - start));
+    sample->lock_held.Record(absl::ToDoubleSeconds(end - locked));
+    sample->locals.Record(static_cast<double>(locals));
+  }
+
+  void RecordRead(Reader& reader, bool advanced) noexcept {
+    reader.local_.Add(Reads(1, advanced ? 0 : 1));
+  }
+
+  void RecordCollect(Time start, Time locked, Time end, size_t locals) {
+    locals_.store(locals, std::memory_order_relaxed);
+    auto sample = collects_.ThreadLocal().Write();
+    sample->lock_wait.Record(absl::ToDoubleSeconds(locked - start));
+    sample->latency.Record(absl::ToDoubleSeconds(end - start));
+    sample->locals.Record(static_cast<double>(locals));
+  }
+
+  // Returns all statistics recorded so far.
+  Totals Collect() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    Updates updates = updates_.Collect();
+    totals_.update_lock_wait += updates.lock_wait;
+    totals_.update_lock_held += updates.lock_held;
+    totals_.update_locals += updates.locals;
+    Collects collects = collects_.Collect();
+    totals_.collect_lock_wait += collects.lock_wait;
+    totals_.collect_latency += collects.latency;
+    totals_.collect_locals += collects.locals;
+    Reads reads = reads_.Collect();
+    totals_.reads += reads.total;
+    totals_.stale_reads += reads.stale;
+    totals_.locals = locals_.load(std::memory_order_relaxed);
+    return totals_;
+  }
+
+ private:
+  struct Updates {
+    Updates() : lock_wait(), lock_held(), locals() {}
+
+    Updates& operator+=(const Updates& other) {
+      lock_wait += other.lock_wait;
+      lock_held += other.lock_held;
+      locals += other.locals;
+      return *this;
+    }
+
+    QuantileSketch<> lock_wait;
+    QuantileSketch<> lock_held;
+    QuantileSketch<> locals;
+  };
+
+  struct Collects {
+    Collects() : lock_wait(), latency(), locals() {}
+
+    Collects& operator+=(const Collects& other) {
+      lock_wait += other.lock_wait;
+      latency += other.latency;
+      locals += other.locals;
+      return *this;
+    }
+
+    QuantileSketch<> lock_wait;
+    QuantileSketch<> latency;
+    QuantileSketch<> locals;
+  };
+
+  ReverseRcu<Updates> updates_;
+  ReverseRcu<Reads> reads_;
+  ReverseRcu<Collects> collects_;
+  std::atomic<size_t> locals_;
+  // Serializes `Collect` calls and guards `totals_`.
+  absl::Mutex lock_;
+  Totals totals_ GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RCU_STATS_H
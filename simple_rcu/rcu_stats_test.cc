@@ -0,0 +1,96 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/rcu_stats.h"
+
+#include <cstdint>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "simple_rcu/rcu.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// Samples are collected from a thread only after its next one, or when it
+// exits. Therefore the tests record them in separate threads.
+
+TEST(RcuStatsTest, RecordsUpdatesAndReads) {
+  Rcu<int, RcuStats> rcu(0);
+  std::thread([&rcu]() {
+    Rcu<int, RcuStats>::Local local(rcu);
+    EXPECT_EQ(*local.Read(), 0);
+    rcu.Update(1);
+    {
+      auto snapshot = local.Read();
+      EXPECT_EQ(*snapshot, 1);
+      // Nested snapshots aren't counted.
+      EXPECT_EQ(*local.Read(), 1);
+    }
+    EXPECT_EQ(*local.Read(), 1);
+  }).join();
+  RcuStats::Totals totals = rcu.stats().Collect();
+  EXPECT_EQ(totals.update_lock_wait.count(), 1);
+  EXPECT_EQ(totals.update_lock_held.count(), 1);
+  ASSERT_EQ(totals.update_locals.count(), 1);
+  EXPECT_NEAR(totals.update_locals.Quantile(0.5), 1,
+              QuantileSketch<>::kRelativeAccuracy);
+  EXPECT_EQ(totals.locals, 1);
+  EXPECT_EQ(totals.reads, 3);
+  EXPECT_EQ(totals.stale_reads, 2);
+  EXPECT_DOUBLE_EQ(totals.stale_read_ratio(), 2.0 / 3);
+  EXPECT_EQ(totals.collect_latency.count(), 0);
+}
+
+TEST(RcuStatsTest, AccumulatesTotals) {
+  Rcu<int, RcuStats> rcu(0);
+  std::thread([&rcu]() { rcu.Update(1); }).join();
+  EXPECT_EQ(rcu.stats().Collect().update_lock_held.count(), 1);
+  std::thread([&rcu]() { rcu.UpdateWith([](int& value) { value++; }); })
+      .join();
+  RcuStats::Totals totals = rcu.stats().Collect();
+  EXPECT_EQ(totals.update_lock_held.count(), 2);
+  EXPECT_EQ(totals.locals, 0);
+}
+
+TEST(RcuStatsTest, RecordsBatchUpdates) {
+  Rcu<int, RcuStats> rcu1(0);
+  Rcu<int, RcuStats> rcu2(0);
+  std::thread([&]() {
+    RcuBatch batch;
+    batch.Add(rcu1, 1).Add(rcu2, 2).Update();
+  }).join();
+  EXPECT_EQ(rcu1.stats().Collect().update_lock_held.count(), 1);
+  EXPECT_EQ(rcu2.stats().Collect().update_lock_held.count(), 1);
+}
+
+TEST(RcuStatsTest, RecordsCollects) {
+  ReverseRcu<int, RcuStats> rcu;
+  std::thread([&rcu]() {
+    ReverseRcu<int, RcuStats>::Local local(rcu);
+    *local.Write() += 42;
+    EXPECT_EQ(rcu.Collect(), 42);
+  }).join();
+  RcuStats::Totals totals = rcu.stats().Collect();
+  EXPECT_EQ(totals.collect_lock_wait.count(), 1);
+  ASSERT_EQ(totals.collect_latency.count(), 1);
+  EXPECT_GE(totals.collect_latency.sum(), 0);
+  EXPECT_EQ(totals.locals, 1);
+  EXPECT_EQ(totals.update_lock_held.count(), 0);
+  EXPECT_EQ(totals.reads, 0);
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -14,6 +14,14 @@
 
 #include "simple_rcu/rcu.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 namespace simple_rcu {
@@ -44,6 +52,237 @@ TEST(RcuTest, ThreadLocalUpdateAndRead) {
   EXPECT_EQ(*local.Read(), 42) << "Thread-local must receive the value";
 }
 
+TEST(RcuTest, UpdateWithAndRead) {
+  Rcu<std::vector<int>> rcu;
+  Rcu<std::vector<int>>::Local local1(rcu);
+  for (int i = 0; i < 5; i++) {
+    rcu.UpdateWith([i](std::vector<int>& value) { value.push_back(i); });
+    EXPECT_EQ(local1.Read()->size(), i + 1);
+  }
+  Rcu<std::vector<int>>::Local local2(rcu);
+  EXPECT_EQ(*local1.Read(), (std::vector<int>{0, 1, 2, 3, 4}));
+  EXPECT_EQ(*local2.Read(), (std::vector<int>{0, 1, 2, 3, 4}))
+      << "Thread registered after UpdateWith must also receive the value";
+}
+
+TEST(RcuTest, UpdateWithReclaimer) {
+  auto value = std::make_shared<int>(1);
+  BackgroundReclaimer reclaimer;
+  Rcu<std::shared_ptr<int>> rcu(value, &reclaimer);
+  {
+    Rcu<std::shared_ptr<int>>::Local local(rcu);
+    EXPECT_EQ(*local.Read(), value);
+    for (int i = 2; i <= 5; i++) {
+      rcu.Update(std::make_shared<int>(i));
+      EXPECT_EQ(**local.Read(), i);
+    }
+    reclaimer.Flush();
+    EXPECT_EQ(value.use_count(), 1)
+        << "Old values must be destroyed by the reclaimer";
+  }
+}
+
+TEST(RcuTest, SynchronizeWaitsForReaders) {
+  Rcu<int> rcu;
+  Rcu<int>::Local local(rcu);
+  rcu.Synchronize();  // The reader has already received the initial value.
+  rcu.Update(1);
+  std::atomic<bool> synchronized(false);
+  std::thread updater([&]() {
+    rcu.Synchronize();
+    synchronized.store(true);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_FALSE(synchronized.load())
+      << "Synchronize must wait for the reader to obtain a new Snapshot";
+  EXPECT_EQ(*local.Read(), 1);
+  updater.join();
+  EXPECT_TRUE(synchronized.load());
+}
+
+TEST(RcuTest, CallRcuAfterReaders) {
+  std::atomic<int> called(0);
+  {
+    Rcu<int> rcu;
+    {
+      Rcu<int>::Local local(rcu);
+      rcu.Update(1);
+      rcu.CallRcu([&called]() { called++; });
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      EXPECT_EQ(called.load(), 0)
+          << "Callback must wait for the reader to obtain a new Snapshot";
+      EXPECT_EQ(*local.Read(), 1);
+      while (called.load() == 0) {
+        std::this_thread::yield();
+      }
+      rcu.Update(2);
+      rcu.CallRcu([&called]() { called++; });
+    }
+  }
+  EXPECT_EQ(called.load(), 2) << "All callbacks must run before destruction";
+}
+
+TEST(RcuTest, DestructorAbortsCallRcuWaitingForIdleReader) {
+  std::atomic<int> called(0);
+  {
+    Rcu<int> rcu;
+    EXPECT_EQ(*rcu.ThreadLocal().Read(), 0);
+    rcu.Update(1);
+    // The thread-local reader never reads again before the RCU is destroyed.
+    rcu.CallRcu([&called]() { called++; });
+  }
+  EXPECT_EQ(called.load(), 1) << "The destructor must run the callback";
+}
+
+TEST(RcuTest, SynchronizeIgnoresDestroyedReaders) {
+  Rcu<int> rcu;
+  std::unique_ptr<Rcu<int>::Local> local(new Rcu<int>::Local(rcu));
+  rcu.Update(1);
+  std::thread updater([&rcu]() { rcu.Synchronize(); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  local.reset();
+  updater.join();
+}
+
+TEST(RcuTest, SynchronizeWithConcurrentlyDestroyedReaders) {
+  static constexpr int kSynchronizations = 1000;
+  Rcu<int> rcu;
+  std::atomic<bool> done(false);
+  std::thread churn([&]() {
+    while (!done.load()) {
+      Rcu<int>::Local local(rcu);
+    }
+  });
+  for (int i = 1; i <= kSynchronizations; i++) {
+    rcu.Update(i);
+    // Must not wait for a `Local` destroyed while being visited.
+    rcu.Synchronize();
+  }
+  done.store(true);
+  churn.join();
+}
+
+TEST(RcuTest, LocalChurnWithoutUpdatesKeepsMemoryBounded) {
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 1000;
+  // Counts its instances, including copies held by `Local`s.
+  struct Counted {
+    Counted() { instances()++; }
+    Counted(const Counted&) { instances()++; }
+    Counted& operator=(const Counted&) = default;
+    ~Counted() { instances()--; }
+
+    static std::atomic<int>& instances() {
+      static std::atomic<int> instances(0);
+      return instances;
+    }
+  };
+  Rcu<Counted> rcu;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&rcu]() {
+      for (int j = 0; j < kIterations; j++) {
+        Rcu<Counted>::Local local(rcu);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // Each `Local` holds 3 instances. Allows for the nodes of 2 slabs of 16.
+  EXPECT_LE(Counted::instances().load(), 1 + 3 * 2 * 16)
+      << "Destroyed Locals must be reclaimed even without any Update";
+}
+
+TEST(RcuTest, ThreadLocalAccessor) {
+  std::vector<std::unique_ptr<Rcu<int>>> rcus;
+  for (int i = 0; i < 10; i++) {
+    rcus.emplace_back(new Rcu<int>(i));
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&rcus]() {
+      for (size_t i = 0; i < rcus.size(); i++) {
+        EXPECT_EQ(*rcus[i]->ThreadLocal().Read(), i);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& rcu : rcus) {
+    rcu->Update(42);
+    EXPECT_EQ(*rcu->ThreadLocal().Read(), 42);
+  }
+  // Destroy the RCUs while the current thread still has its `Local`s.
+  rcus.clear();
+}
+
+TEST(RcuTest, WaitForUpdate) {
+  Rcu<int> rcu;
+  Rcu<int>::Local local(rcu);
+  EXPECT_FALSE(local.WaitForUpdate(absl::Now() + absl::Milliseconds(10)))
+      << "Must time out without an update";
+  rcu.Update(1);
+  EXPECT_TRUE(local.WaitForUpdate(absl::InfiniteFuture()))
+      << "Must return immediately if an update is already available";
+  EXPECT_EQ(*local.Read(), 1);
+  std::thread updater([&rcu]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    rcu.Update(2);
+  });
+  EXPECT_TRUE(local.WaitForUpdate(absl::InfiniteFuture()));
+  EXPECT_EQ(*local.Read(), 2);
+  updater.join();
+}
+
+TEST(RcuTest, ConcurrentWaitForUpdate) {
+  static constexpr int kUpdates = 1000;
+  Rcu<int> rcu;
+  std::vector<std::thread> waiters;
+  for (int i = 0; i < 4; i++) {
+    waiters.emplace_back([&rcu]() {
+      Rcu<int>::Local local(rcu);
+      while (*local.Read() < kUpdates) {
+        ASSERT_TRUE(local.WaitForUpdate(absl::Now() + absl::Seconds(60)))
+            << "A wakeup must not be lost";
+      }
+    });
+  }
+  for (int i = 1; i <= kUpdates; i++) {
+    rcu.Update(i);
+  }
+  for (auto& thread : waiters) {
+    thread.join();
+  }
+}
+
+TEST(RcuTest, SnapshotVersion) {
+  Rcu<int> rcu;
+  Rcu<int>::Local local1(rcu);
+  {
+    auto snapshot = local1.Read();
+    EXPECT_EQ(snapshot.version(), 0);
+    EXPECT_FALSE(snapshot.advanced());
+  }
+  rcu.Update(1);
+  rcu.UpdateWith([](int& value) { value++; });
+  {
+    auto snapshot = local1.Read();
+    EXPECT_EQ(*snapshot, 2);
+    EXPECT_EQ(snapshot.version(), 2);
+    EXPECT_TRUE(snapshot.advanced());
+    auto nested = local1.Read();
+    EXPECT_TRUE(nested.advanced())
+        << "Nested Snapshot must report the outermost one";
+  }
+  EXPECT_FALSE(local1.Read().advanced());
+  EXPECT_EQ(local1.Read().version(), 2);
+  Rcu<int>::Local local2(rcu);
+  EXPECT_EQ(local2.Read().version(), 2)
+      << "Thread registered after Update must receive the version";
+}
+
 TEST(RcuTest, ReadRemainsStable) {
   Rcu<int> rcu(42);
   Rcu<int>::Local local(rcu);
@@ -58,5 +297,105 @@ TEST(RcuTest, ReadRemainsStable) {
       << "A nested reference must have the same value as an outer one";
 }
 
+TEST(RcuTest, ConcurrentRegistrationAndUpdates) {
+  static constexpr int kUpdates = 10000;
+  Rcu<int> rcu;
+  std::atomic<int> last_updated(0);
+  std::thread updater([&]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      rcu.Update(i);
+      last_updated.store(i);
+    }
+  });
+  int registrations = 0;
+  while (last_updated.load() < kUpdates) {
+    const int updated = last_updated.load();
+    Rcu<int>::Local local(rcu);
+    const int read = *local.Read();
+    ASSERT_GE(read, updated)
+        << "A new Local must never observe a value older than the last "
+           "finished Update";
+    ASSERT_GE(*local.Read(), read) << "A Local must never go back in time";
+    registrations++;
+  }
+  updater.join();
+  Rcu<int>::Local local(rcu);
+  EXPECT_EQ(*local.Read(), kUpdates);
+  EXPECT_GT(registrations, 0);
+}
+
+TEST(RcuTest, UpdateCoalescingAndRead) {
+  Rcu<int> rcu;
+  Rcu<int>::Local local(rcu);
+  rcu.UpdateCoalescing(42);
+  EXPECT_EQ(*local.Read(), 42)
+      << "Uncontended update must be distributed before returning";
+}
+
+TEST(RcuTest, ConcurrentUpdateCoalescingDistributesLastValue) {
+  static constexpr int kThreads = 4;
+  static constexpr int kUpdates = 1000;
+  Rcu<int> rcu(-1);
+  Rcu<int>::Local local(rcu);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&rcu, i]() {
+      for (int j = 1; j <= kUpdates; j++) {
+        rcu.UpdateCoalescing(i * kUpdates + j);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  const int value = *local.Read();
+  EXPECT_EQ(value % kUpdates, 0)
+      << "The last value of one of the threads must be distributed, got "
+      << value;
+}
+
+TEST(RcuTest, BatchUpdateAndRead) {
+  Rcu<int> rcu1;
+  Rcu<const std::string> rcu2;
+  Rcu<int>::Local local1(rcu1);
+  Rcu<const std::string>::Local local2(rcu2);
+  RcuBatch batch;
+  batch.Add(rcu1, 1).Add(rcu2, "foo").Add(rcu1, 42);
+  EXPECT_EQ(*local1.Read(), 0) << "Values must not be updated before Update()";
+  batch.Update();
+  EXPECT_EQ(*local1.Read(), 42) << "The last value added must win";
+  EXPECT_EQ(local1.Read().version(), 1)
+      << "A value replaced within the batch must never be distributed";
+  EXPECT_EQ(*local2.Read(), "foo");
+  batch.Add(rcu2, "bar").Update();
+  EXPECT_EQ(*local1.Read(), 42) << "A reused batch must be cleared";
+  EXPECT_EQ(*local2.Read(), "bar");
+}
+
+TEST(RcuTest, BatchReadIsConsistent) {
+  static constexpr int kUpdates = 10000;
+  Rcu<int> rcu1;
+  Rcu<int> rcu2;
+  Rcu<int>::Local local1(rcu1);
+  Rcu<int>::Local local2(rcu2);
+  RcuBatch batch;
+  std::thread updater([&]() {
+    for (int i = 1; i <= kUpdates; i++) {
+      batch.Add(rcu1, i).Add(rcu2, i).Update();
+    }
+  });
+  bool consistent = true;
+  int last = 0;
+  while (last < kUpdates) {
+    const std::pair<int, int> read = batch.Read([&]() {
+      return std::make_pair(*local1.Read(), *local2.Read());
+    });
+    consistent &= read.first == read.second;
+    last = read.first;
+  }
+  updater.join();
+  EXPECT_TRUE(consistent) << "Values read must come from the same batch";
+}
+
 }  // namespace
 }  // namespace simple_rcu
@@ -0,0 +1,117 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_RECLAIMER_H
+#define _SIMPLE_RCU_RECLAIMER_H
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace simple_rcu {
+
+// Values that are no longer needed and are to be destroyed by a `Reclaimer`.
+class Retired {
+ public:
+  virtual ~Retired() = default;
+};
+
+template <typename T>
+class RetiredValues final : public Retired {
+ public:
+  explicit RetiredValues(std::vector<T> values) : values_(std::move(values)) {}
+
+ private:
+  std::vector<T> values_;
+};
+
+// Decides when and where old values are destroyed, so that expensive
+// destructors don't need to run on a latency-sensitive thread.
+class Reclaimer {
+ public:
+  virtual ~Reclaimer() = default;
+
+  // Takes ownership of `retired` and destroys it eventually.
+  // Must be thread-safe.
+  virtual void Retire(std::unique_ptr<Retired> retired) = 0;
+};
+
+// Destroys retired values on a dedicated background thread.
+class BackgroundReclaimer final : public Reclaimer {
+ public:
+  BackgroundReclaimer()
+      : lock_(),
+        queue_(),
+        stop_(false),
+        thread_(&BackgroundReclaimer::Work, this) {}
+  // Destroys all values retired so far before returning.
+  ~BackgroundReclaimer() override LOCKS_EXCLUDED(lock_) {
+    {
+      absl::MutexLock mutex(&lock_);
+      stop_ = true;
+    }
+    thread_.join();
+  }
+
+  // Thread-safe. Never waits for destruction of previously retired values.
+  void Retire(std::unique_ptr<Retired> retired) override LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    queue_.push_back(std::move(retired));
+  }
+
+  // Blocks until all values retired before this call are destroyed.
+  // Thread-safe.
+  void Flush() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    lock_.Await(absl::Condition(
+        +[](std::deque<std::unique_ptr<Retired>>* queue) {
+          return queue->empty();
+        },
+        &queue_));
+  }
+
+ private:
+  void Work() LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    while (true) {
+      lock_.Await(absl::Condition(this, &BackgroundReclaimer::HasWork));
+      if (queue_.empty()) {
+        return;
+      }
+      std::unique_ptr<Retired> retired = std::move(queue_.front());
+      // Keep the queue non-empty during destruction, so that `Flush()` waits.
+      lock_.Unlock();
+      retired.reset();
+      lock_.Lock();
+      queue_.pop_front();
+    }
+  }
+
+  bool HasWork() const EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return stop_ || !queue_.empty();
+  }
+
+  absl::Mutex lock_;
+  std::deque<std::unique_ptr<Retired>> queue_ GUARDED_BY(lock_);
+  bool stop_ GUARDED_BY(lock_);
+  std::thread thread_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_RECLAIMER_H
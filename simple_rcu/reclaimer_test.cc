@@ -0,0 +1,65 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/reclaimer.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+std::unique_ptr<Retired> RetireCopies(const std::shared_ptr<int>& value,
+                                      int copies) {
+  return std::unique_ptr<Retired>(new RetiredValues<std::shared_ptr<int>>(
+      std::vector<std::shared_ptr<int>>(copies, value)));
+}
+
+TEST(BackgroundReclaimerTest, FlushDestroysRetired) {
+  auto value = std::make_shared<int>(42);
+  BackgroundReclaimer reclaimer;
+  reclaimer.Retire(RetireCopies(value, 3));
+  reclaimer.Retire(RetireCopies(value, 2));
+  reclaimer.Flush();
+  EXPECT_EQ(value.use_count(), 1);
+}
+
+TEST(BackgroundReclaimerTest, DestructorDestroysRetired) {
+  auto value = std::make_shared<int>(42);
+  {
+    BackgroundReclaimer reclaimer;
+    reclaimer.Retire(RetireCopies(value, 3));
+  }
+  EXPECT_EQ(value.use_count(), 1);
+}
+
+TEST(BackgroundReclaimerTest, DestroysOnAnotherThread) {
+  struct RecordsThread final : public Retired {
+    explicit RecordsThread(std::thread::id& id) : id_(id) {}
+    ~RecordsThread() override { id_ = std::this_thread::get_id(); }
+
+    std::thread::id& id_;
+  };
+  std::thread::id id = std::this_thread::get_id();
+  BackgroundReclaimer reclaimer;
+  reclaimer.Retire(std::unique_ptr<Retired>(new RecordsThread(id)));
+  reclaimer.Flush();
+  EXPECT_NE(id, std::this_thread::get_id());
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -1,23 +1,62 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_REVERSE_RCU_H
+#define _SIMPLE_RCU_REVERSE_RCU_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
-#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/utility/utility.h"
 #include "simple_rcu/local_3state_rcu.h"
+#include "simple_rcu/local_registry.h"
+#include "simple_rcu/stats_policy.h"
+#include "simple_rcu/thread_local_locals.h"
 
 namespace simple_rcu {
 
+// Moves the value out of `value` and resets `value` to `T()`. Used by
+// `ReverseRcu::Collect` for values handed over by writers, which then get
+// `value` back for their next writes.
+//
+// Types that own memory can provide an overload found by argument-dependent
+// lookup that resets `value` in place, so that writers keep its capacity
+// instead of reallocating it after each hand-over.
+template <typename T>
+T TakeAndReset(T& value) {
+  return absl::exchange(value, T());
+}
+
 // Class dual to `Rcu<T>`. The flow of information is reversed - from writers
 // ("readers") that actually store information and then it's collected from all
 // of them during the collect ("update") phase.
 //
 // `T` must define `T& operator+=(T&&)` (or a variant with any compatible
 // argument type) to combine values from thread-`Local` variables to a single
-// one.
+// one. See also `TakeAndReset`.
 //
 // This is a low-level class, on top of which we can build a more user-friendly
 // interface for collecting metrics.
-template <typename T>
+//
+// `Stats` is a policy that records statistics about collections, see
+// `NoRcuStats`. By default nothing is recorded.
+template <typename T, typename Stats = NoRcuStats>
 class ReverseRcu {
  public:
   static_assert(std::is_default_constructible<T>::value,
@@ -28,6 +67,23 @@ class ReverseRcu {
 
   class Local;
 
+ private:
+  // State shared between a `Local` writer thread and collecting threads.
+  struct Shard {
+    // Allows `Snapshot` to `TryRead()` from the start.
+    Shard() : local_rcu(), handoff_requested(false) {
+      local_rcu.ForceUpdate();
+    }
+
+    Local3StateRcu<T> local_rcu;
+    // Set by `Collect` if the writer hasn't handed over anything since the
+    // previous one, so that it does so on its next write.
+    std::atomic<bool> handoff_requested;
+  };
+  using Registry = LocalRegistry<Shard>;
+
+ public:
+
   // Holds a (write) reference to a RCU value for the current thread.
   // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
   // Callers are expected to limit the lifetime of `Snapshot` to as short as
@@ -42,12 +98,12 @@ class ReverseRcu {
 
     ~Snapshot() noexcept {
       if (--registrar_.snapshot_depth_ == 0) {
-        registrar_.local_rcu_.TryRead();
+        registrar_.Written();
       }
     }
 
     T* operator->() noexcept { return &**this; }
-    T& operator*() noexcept { return registrar_.local_rcu_.Read(); }
+    T& operator*() noexcept { return registrar_.local_rcu().Read(); }
 
    private:
     Snapshot(Local& registrar) noexcept : registrar_(registrar) {
@@ -65,48 +121,94 @@ class ReverseRcu {
   // separate `Local` instance for each reader thread.
   class Local final {
    public:
-    // Thread-safe.
-    Local(ReverseRcu& rcu) LOCKS_EXCLUDED(rcu.lock_)
-        : rcu_(rcu), snapshot_depth_(0), local_rcu_() {
-      // Allow `Snapshot` to `TryRead()` from the start.
-      local_rcu_.ForceUpdate();
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.threads_.insert(this);
-    }
-    ~Local() LOCKS_EXCLUDED(rcu_.lock_) {
-      absl::MutexLock mutex(&rcu_.lock_);
-      rcu_.value_ += Collect();
-      rcu_.threads_.erase(this);
-    }
+    // Thread-safe and lock-free. Never waits for an ongoing `Collect`.
+    //
+    // The local value is handed over to `Collect` once every
+    // `writes_per_handoff` writes (if `Collect` has been called since the
+    // previous hand-over). The default 1 makes written values available as soon
+    // as possible. Larger values amortize the cost of the hand-over, at the
+    // expense of delaying written values. A `Collect` that finds nothing handed
+    // over requests a hand-over on the next write regardless of the count, so
+    // that values of rarely writing threads aren't delayed indefinitely.
+    Local(ReverseRcu& rcu, uint_fast32_t writes_per_handoff = 1)
+        : node_(rcu.threads_.Add()),
+          snapshot_depth_(0),
+          writes_per_handoff_(writes_per_handoff > 0 ? writes_per_handoff : 1),
+          writes_until_handoff_(writes_per_handoff_) {}
+    // Thread-safe and wait-free. The remaining value is collected by the next
+    // `Collect`.
+    ~Local() { Registry::Remove(node_); }
 
     // Obtains a write snapshot to the local value to be collected by the RCU.
     // This is a very fast, lock-free and atomic operation.
     // Thread-compatible, but not thread-safe.
     Snapshot Write() noexcept { return Snapshot(*this); }
 
+    // Equivalent to `*Write() += delta`, but faster, as it skips `Snapshot`
+    // bookkeeping. Must not be called while the current thread holds a
+    // `Snapshot` obtained from this `Local`.
+    // Thread-compatible, but not thread-safe.
+    template <typename U>
+    void Add(U&& delta) {
+      local_rcu().Read() += std::forward<U>(delta);
+      Written();
+    }
+
    private:
-    // Thread-compatible.
-    T Collect() EXCLUSIVE_LOCKS_REQUIRED(rcu_.lock_) {
-      local_rcu_.ForceUpdate();
-      return absl::exchange(local_rcu_.Update(), T());
+    // Called after each outermost write.
+    void Written() noexcept {
+      std::atomic<bool>& requested = node_->value().handoff_requested;
+      // A plain load that, unless `Collect` sets it, keeps the cache line
+      // shared.
+      const bool handoff_requested = requested.load(std::memory_order_relaxed);
+      if (--writes_until_handoff_ == 0 || handoff_requested) {
+        writes_until_handoff_ = writes_per_handoff_;
+        local_rcu().TryRead();
+        if (handoff_requested) {
+          requested.store(false, std::memory_order_relaxed);
+        }
+      }
     }
 
-    ReverseRcu& rcu_;
+    Local3StateRcu<T>& local_rcu() noexcept { return node_->value().local_rcu; }
+
+    typename Registry::Node* const node_;
     // Incremented with each `Snapshot` instance. Ensures that `TryRead` is
     // invoked only after the outermost `Snapshot` is destroyed, keeping
     // the reference unchanged for its whole lifetime.
     int_fast16_t snapshot_depth_;
-    Local3StateRcu<T> local_rcu_;
+    const uint_fast32_t writes_per_handoff_;
+    // Counts down writes until `TryRead` is invoked.
+    uint_fast32_t writes_until_handoff_;
 
     friend class ReverseRcu;
   };
 
   // Constructs a RCU with an initial value `T()`.
-  ReverseRcu() : lock_(), value_(), threads_() {}
+  ReverseRcu() : lock_(), threads_(), stats_(), thread_locals_(*this) {}
+
+  // Returns the `Local` instance of the current thread, registering it on
+  // first use. It's unregistered when the thread exits, or just discarded if
+  // this RCU is destroyed first. This avoids managing `Local` instances
+  // manually, in particular for dynamically created RCUs.
+  //
+  // Thread-safe. O(1) and lock-free, except for the first call on a thread.
+  Local& ThreadLocal() { return thread_locals_.Get(); }
+
+  // The statistics recorded by this RCU.
+  Stats& stats() noexcept { return stats_; }
 
   // Reads values from all registered `Local` instances, including ones that
   // have been destroyed since the last call.
-  // Returns the collected value and resets the internal variable to `T()`.
+  // Returns the collected value, values from `Local` instances are reset to
+  // `T()`.
+  //
+  // The `Local` instances are drained in chunks of `kSlabsPerChunk` registry
+  // slabs. The internal lock is held only while moving values out of a chunk
+  // and released between chunks, so that concurrent calls interleave instead
+  // of waiting for each other's whole iteration. Values of each chunk are
+  // combined by the calling thread outside of the lock, pairwise in a
+  // balanced tree, and so are the partial results of all chunks.
   //
   // This method isn't tied in any particular way to a `Local` instance
   // corresponding to the current thread, and can be called also by threads
@@ -114,20 +216,95 @@ class ReverseRcu {
   //
   // Thread-safe.
   T Collect() LOCKS_EXCLUDED(lock_) {
+    const typename Stats::Time start = Stats::Now();
+    typename Stats::Time locked;
+    size_t locals = 0;
+    std::vector<T> partials;
+    std::vector<T> values;
+    typename Registry::Cursor cursor;
+    do {
+      Drain(cursor, values, locked, locals);
+      if (!values.empty()) {
+        partials.push_back(Combine(values, 0, values.size()));
+        values.clear();
+      }
+    } while (!cursor.done());
+    T result = Combine(partials, 0, partials.size());
+    stats_.RecordCollect(start, locked, Stats::Now(), locals);
+    return result;
+  }
+
+ private:
+  // With the default `LocalRegistry::kSlabSize` a chunk has 64 `Local`
+  // instances.
+  static constexpr size_t kSlabsPerChunk = 4;
+
+  // Moves values out of the `Local` instances of the next chunk at `cursor`
+  // that have handed one over, appending them to `values`.
+  // The first call sets `locked` to the time `lock_` was acquired. Adds the
+  // number of live `Local` instances to `locals`.
+  void Drain(typename Registry::Cursor& cursor, std::vector<T>& values,
+             typename Stats::Time& locked, size_t& locals)
+      LOCKS_EXCLUDED(lock_) {
+    const bool first = !cursor.started();
     absl::MutexLock mutex(&lock_);
-    for (Local* thread : threads_) {
-      value_ += thread->Collect();
+    if (first) {
+      locked = Stats::Now();
     }
-    return absl::exchange(value_, T());
+    threads_.ForEachChunk(
+        cursor, kSlabsPerChunk,
+        [&values, &locals](Shard& shard) {
+          locals++;
+          // If the in-flight instance is still "U->R", the writer hasn't
+          // handed over anything since the last `Collect`; it still has the
+          // empty `T()` passed to it at that time. Skip it, so that idle
+          // writers cost nothing, and request a hand-over on its next write.
+          if (shard.local_rcu.ReclaimByUpdate() == nullptr) {
+            if (!shard.handoff_requested.load(std::memory_order_relaxed)) {
+              shard.handoff_requested.store(true, std::memory_order_relaxed);
+            }
+            return;
+          }
+          shard.local_rcu.ForceUpdate();
+          values.push_back(TakeAndReset(shard.local_rcu.Update()));
+        },
+        [&values](Shard& shard) {
+          // The writer thread is gone, so collect also its value that it
+          // hasn't passed by `TryRead()`.
+          T* in_flight = shard.local_rcu.ReclaimByUpdate();
+          if (in_flight != nullptr) {
+            values.push_back(std::move(*in_flight));
+          }
+          values.push_back(std::move(shard.local_rcu.Read()));
+        });
   }
 
- private:
+  // Combines `values[begin..end)` pairwise in a balanced tree.
+  static T Combine(std::vector<T>& values, size_t begin, size_t end) {
+    if (begin == end) {
+      return T();
+    } else if (end - begin == 1) {
+      return std::move(values[begin]);
+    }
+    const size_t middle = begin + (end - begin) / 2;
+    T left = Combine(values, begin, middle);
+    left += Combine(values, middle, end);
+    return left;
+  }
+
+  // Serializes draining chunks of `threads_`.
   absl::Mutex lock_;
-  // The current value that has been collected from all thread-`Local`
-  // instances.
-  T value_ GUARDED_BY(lock_);
-  // List of registered thread-`Local` instances.
-  absl::flat_hash_set<Local*> threads_ GUARDED_BY(lock_);
+  // Registered thread-`Local` instances. Iterated only while holding `lock_`,
+  // possibly in chunks.
+  Registry threads_;
+  Stats stats_;
+  // Must be the last member, see `ThreadLocalLocals`.
+  ThreadLocalLocals<ReverseRcu> thread_locals_;
 };
 
+template <typename T, typename Stats>
+constexpr size_t ReverseRcu<T, Stats>::kSlabsPerChunk;
+
 }  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_REVERSE_RCU_H
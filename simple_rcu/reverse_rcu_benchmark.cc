@@ -0,0 +1,158 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+namespace {
+
+// A 4 KiB value, such as a histogram with many buckets.
+struct Buckets {
+  Buckets() : counts() {}
+
+  Buckets& operator+=(Buckets&& other) {
+    for (size_t i = 0; i < counts.size(); i++) {
+      counts[i] += other.counts[i];
+    }
+    return *this;
+  }
+
+  std::array<uint64_t, 512> counts;
+};
+
+static void Add(uint64_t& value, int_fast32_t i) { value += i; }
+static void Add(Buckets& value, int_fast32_t i) {
+  value.counts[i % value.counts.size()]++;
+}
+
+// Each benchmark thread is a writer. Thread 0 also starts a collector thread
+// that calls `Collect()` every `state.range(0)` microseconds, or continuously
+// if it's 0.
+template <typename T>
+static void Writes(benchmark::State& state) {
+  std::atomic<bool> finished(false);
+  static ReverseRcu<T> rcu;
+  std::deque<std::thread> collector_threads;
+  if (state.thread_index() == 0) {
+    collector_threads.emplace_back([&]() {
+      const std::chrono::microseconds period(state.range(0));
+      while (!finished.load()) {
+        benchmark::DoNotOptimize(rcu.Collect());
+        if (period.count() > 0) {
+          std::this_thread::sleep_for(period);
+        }
+      }
+    });
+  }
+  static thread_local typename ReverseRcu<T>::Local writer(rcu);
+  int_fast32_t writes = 0;
+  for (auto _ : state) {
+    Add(*writer.Write(), ++writes);
+    benchmark::ClobberMemory();
+  }
+  finished.store(true);
+  for (auto& thread : collector_threads) {
+    thread.join();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Like `Writes<uint64_t>`, but uses `Local::Add` and hands the value over
+// only once every `state.range(1)` writes.
+static void BM_BatchedAdds(benchmark::State& state) {
+  std::atomic<bool> finished(false);
+  static ReverseRcu<uint64_t> rcu;
+  std::deque<std::thread> collector_threads;
+  if (state.thread_index() == 0) {
+    collector_threads.emplace_back([&]() {
+      const std::chrono::microseconds period(state.range(0));
+      while (!finished.load()) {
+        benchmark::DoNotOptimize(rcu.Collect());
+        if (period.count() > 0) {
+          std::this_thread::sleep_for(period);
+        }
+      }
+    });
+  }
+  ReverseRcu<uint64_t>::Local writer(rcu, state.range(1));
+  for (auto _ : state) {
+    writer.Add(1);
+    benchmark::ClobberMemory();
+  }
+  finished.store(true);
+  for (auto& thread : collector_threads) {
+    thread.join();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BatchedAdds)
+    ->ThreadRange(1, 4)
+    ->Args({0, 1})
+    ->Args({0, 64})
+    ->Args({100, 1})
+    ->Args({100, 64});
+
+// The benchmark thread is the collector, `state.range(0)` threads write
+// continuously.
+template <typename T>
+static void Collects(benchmark::State& state) {
+  std::atomic<bool> finished(false);
+  static ReverseRcu<T> rcu;
+  std::deque<std::thread> writer_threads;
+  for (int i = 0; i < state.range(0); i++) {
+    writer_threads.emplace_back([&]() {
+      static thread_local typename ReverseRcu<T>::Local writer(rcu);
+      int_fast32_t writes = 0;
+      while (!finished.load()) {
+        Add(*writer.Write(), ++writes);
+      }
+    });
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(rcu.Collect());
+  }
+  finished.store(true);
+  for (auto& thread : writer_threads) {
+    thread.join();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.counters["writers"] = state.range(0);
+}
+
+static void BM_Writes(benchmark::State& state) { Writes<uint64_t>(state); }
+BENCHMARK(BM_Writes)->ThreadRange(1, 4)->Arg(0)->Arg(100)->Arg(10000);
+
+static void BM_WritesBuckets(benchmark::State& state) {
+  Writes<Buckets>(state);
+}
+BENCHMARK(BM_WritesBuckets)->ThreadRange(1, 4)->Arg(0)->Arg(100)->Arg(10000);
+
+static void BM_Collects(benchmark::State& state) { Collects<uint64_t>(state); }
+BENCHMARK(BM_Collects)->Arg(1)->Arg(4)->Arg(16);
+
+static void BM_CollectsBuckets(benchmark::State& state) {
+  Collects<Buckets>(state);
+}
+BENCHMARK(BM_CollectsBuckets)->Arg(1)->Arg(4)->Arg(16);
+
+}  // namespace
+}  // namespace simple_rcu
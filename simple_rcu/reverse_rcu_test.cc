@@ -14,7 +14,10 @@
 
 #include "simple_rcu/reverse_rcu.h"
 
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -33,6 +36,134 @@ TEST(ReverseRcuTest, WriteAndCollect) {
       << "Should receive value from both live and terminated threads";
 }
 
+TEST(ReverseRcuTest, MultipleWritesAndCollectTerminated) {
+  ReverseRcu<int> rcu;
+  {
+    ReverseRcu<int>::Local local(rcu);
+    *local.Write() += 1;
+    *local.Write() += 2;
+    *local.Write() += 3;
+  }
+  EXPECT_EQ(rcu.Collect(), 6)
+      << "Should receive all values written by a terminated thread";
+}
+
+TEST(ReverseRcuTest, ConcurrentRegistrationAndCollect) {
+  static constexpr int kThreads = 4;
+  static constexpr int kIterations = 1000;
+  ReverseRcu<int> rcu;
+  std::atomic<int> finished(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; i++) {
+    threads.emplace_back([&]() {
+      for (int j = 0; j < kIterations; j++) {
+        ReverseRcu<int>::Local local(rcu);
+        *local.Write() += 1;
+      }
+      finished++;
+    });
+  }
+  int collected = 0;
+  while (finished.load() < kThreads) {
+    collected += rcu.Collect();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  collected += rcu.Collect();
+  EXPECT_EQ(collected, kThreads * kIterations)
+      << "Each value must be collected exactly once";
+}
+
+TEST(ReverseRcuTest, AddAndCollect) {
+  ReverseRcu<int> rcu;
+  {
+    ReverseRcu<int>::Local local(rcu);
+    local.Add(1);
+    local.Add(2);
+    EXPECT_EQ(rcu.Collect(), 1) << "Only the first value has been handed over";
+    local.Add(3);
+  }
+  EXPECT_EQ(rcu.Collect(), 5) << "Should receive the value of a finished thread";
+}
+
+TEST(ReverseRcuTest, BatchedAddAndCollect) {
+  ReverseRcu<int> rcu;
+  {
+    ReverseRcu<int>::Local local(rcu, /*writes_per_handoff=*/4);
+    for (int i = 0; i < 3; i++) {
+      local.Add(1);
+    }
+    EXPECT_EQ(rcu.Collect(), 0) << "Values must not be handed over yet";
+    local.Add(1);
+    EXPECT_EQ(rcu.Collect(), 4) << "Values must be handed over every 4 writes";
+    for (int i = 0; i < 3; i++) {
+      *local.Write() += 1;
+    }
+    EXPECT_EQ(rcu.Collect(), 0) << "Values must not be handed over yet";
+  }
+  EXPECT_EQ(rcu.Collect(), 3) << "Should receive the value of a finished thread";
+}
+
+TEST(ReverseRcuTest, CollectRequestsHandoff) {
+  ReverseRcu<int> rcu;
+  ReverseRcu<int>::Local local(rcu, /*writes_per_handoff=*/100);
+  local.Add(1);
+  EXPECT_EQ(rcu.Collect(), 0) << "Values must not be handed over yet";
+  local.Add(2);
+  EXPECT_EQ(rcu.Collect(), 3)
+      << "The write after a Collect must hand over values";
+  local.Add(4);
+  EXPECT_EQ(rcu.Collect(), 0)
+      << "Without a pending request the count must apply again";
+}
+
+// Counts calls to `operator+=`.
+struct CountingSum {
+  CountingSum& operator+=(CountingSum&& other) {
+    sum += other.sum;
+    additions++;
+    return *this;
+  }
+
+  int sum = 0;
+  static int additions;
+};
+int CountingSum::additions = 0;
+
+TEST(ReverseRcuTest, CollectSkipsIdleLocals) {
+  ReverseRcu<CountingSum> rcu;
+  std::vector<std::unique_ptr<ReverseRcu<CountingSum>::Local>> locals;
+  for (int i = 0; i < 10; i++) {
+    locals.emplace_back(new ReverseRcu<CountingSum>::Local(rcu));
+  }
+  locals[3]->Write()->sum += 1;
+  locals[7]->Write()->sum += 2;
+  CountingSum::additions = 0;
+  EXPECT_EQ(rcu.Collect().sum, 3);
+  EXPECT_EQ(CountingSum::additions, 1)
+      << "Only values of the two active Locals should be combined";
+  CountingSum::additions = 0;
+  EXPECT_EQ(rcu.Collect().sum, 0);
+  EXPECT_EQ(CountingSum::additions, 0) << "All Locals are idle";
+}
+
+TEST(ReverseRcuTest, CollectInChunks) {
+  ReverseRcu<int> rcu;
+  std::vector<std::unique_ptr<ReverseRcu<int>::Local>> locals;
+  for (int i = 1; i <= 1000; i++) {
+    locals.emplace_back(new ReverseRcu<int>::Local(rcu));
+    *locals.back()->Write() += i;
+  }
+  // Destroy Locals spread over several chunks.
+  for (int i = 0; i < 1000; i += 100) {
+    locals[i].reset();
+  }
+  EXPECT_EQ(rcu.Collect(), 500500)
+      << "Should receive values from all threads, including destroyed ones";
+  EXPECT_EQ(rcu.Collect(), 0) << "Values must be collected only once";
+}
+
 TEST(ReverseRcuTest, WriteAndCollectMoveable) {
   struct Value {
     Value() : value(0) {}
@@ -0,0 +1,225 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_SEQLOCK_RCU_H
+#define _SIMPLE_RCU_SEQLOCK_RCU_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/thread_local_locals.h"
+
+namespace simple_rcu {
+
+// Alternative to `Rcu<T>` with the same `Local`/`Snapshot` interface for
+// trivially copyable `T`, such as moderately sized plain configuration
+// structs.
+//
+// There is just a single shared instance of `T` protected by a sequence
+// counter ("seqlock"). `Update` writes it in O(sizeof(T)) regardless of the
+// number of readers, incrementing the counter before and after. A reader
+// optimistically copies the value into its `Local` and retries if the counter
+// has changed meanwhile. The copy is skipped altogether if the counter is the
+// same as at the last copy, which costs a single atomic load.
+//
+// Compared to `Rcu<T>`, each `Local` keeps one instance of `T` instead of
+// three and registering it costs nothing, but reads copy the value after each
+// update and might need to retry while an update is in progress. Therefore
+// reads aren't lock-free: They are optimistic and retry until no update is in
+// progress, so a writer preempted in the middle of `Update` blocks all readers
+// that need the new value until it resumes.
+template <typename T>
+class SeqlockRcu {
+ public:
+  class Local;
+
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+  static_assert(std::is_default_constructible<T>::value,
+                "T must be default constructible");
+
+  // Holds a read reference to a RCU value for the current thread.
+  // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
+  // Callers are expected to limit the lifetime of `Snapshot` to as short as
+  // possible.
+  // Thread-compatible (but not thread-safe), reentrant.
+  class Snapshot final {
+   public:
+    Snapshot(Snapshot&& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot(const Snapshot& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot& operator=(Snapshot&&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot() noexcept { registrar_.snapshot_depth_--; }
+
+    const T* operator->() const noexcept { return &**this; }
+    const T& operator*() const noexcept { return registrar_.value_; }
+
+   private:
+    Snapshot(Local& registrar) noexcept : registrar_(registrar) {
+      if (registrar_.snapshot_depth_++ == 0) {
+        registrar_.Acquire();
+      }
+    }
+
+    Local& registrar_;
+
+    friend class Local;
+  };
+
+  // Interface to the RCU local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the `Read()`
+  // method is only thread-compatible. Callers are expected to construct a
+  // separate `Local` instance for each reader thread.
+  class Local final {
+   public:
+    // Thread-safe. Doesn't register anywhere, but copies the current value,
+    // retrying while an update is in progress.
+    Local(SeqlockRcu& rcu)
+        : rcu_(rcu), value_(), sequence_(rcu.Load(value_)),
+          snapshot_depth_(0) {}
+
+    // Obtains a read snapshot to the current value held by the RCU.
+    // A single atomic load if the value hasn't changed since the last
+    // outermost `Snapshot`. Otherwise copies the value, retrying while an
+    // update is in progress, so it can block while an `Update` is preempted.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Read() noexcept { return Snapshot(*this); }
+
+   private:
+    // Copies the current value of the RCU into `value_`, unless it's already
+    // there.
+    void Acquire() noexcept {
+      if (rcu_.sequence_.load(std::memory_order_acquire) != sequence_) {
+        sequence_ = rcu_.Load(value_);
+      }
+    }
+
+    SeqlockRcu& rcu_;
+    // This thread's copy of the value, kept even after all `Snapshot`
+    // instances are destroyed, so that the next `Snapshot` can skip copying
+    // it if it hasn't changed.
+    T value_;
+    // The sequence number of `value_`.
+    uint64_t sequence_;
+    // Incremented with each `Snapshot` instance. Ensures that `Acquire` is
+    // invoked only for the outermost `Snapshot`, keeping its value unchanged
+    // for its whole lifetime.
+    int_fast16_t snapshot_depth_;
+
+    friend class SeqlockRcu;
+  };
+
+  // Constructs a RCU with an initial value `T()`.
+  SeqlockRcu() : SeqlockRcu(T()) {}
+  SeqlockRcu(T initial_value)
+      : lock_(),
+        value_(initial_value),
+        sequence_(0),
+        words_(),
+        thread_locals_(*this) {
+    std::array<uint64_t, kWords> words = ToWords(initial_value);
+    for (size_t i = 0; i < kWords; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the `Local` instance of the current thread, constructing it on
+  // first use. It's destroyed when the thread exits, or just discarded if
+  // this RCU is destroyed first.
+  //
+  // Thread-safe. O(1) and lock-free, except for the first call on a thread.
+  // Reading through the returned `Local` can block as described above.
+  Local& ThreadLocal() { return thread_locals_.Get(); }
+
+  // Makes `value` available to all `Local` threads and returns the previous
+  // value. Readers pick it up with their next outermost `Snapshot`.
+  // O(sizeof(T)), independent of the number of readers.
+  //
+  // Thread-safe. Concurrent calls are serialized.
+  T Update(T value) LOCKS_EXCLUDED(lock_) {
+    const std::array<uint64_t, kWords> words = ToWords(value);
+    absl::MutexLock mutex(&lock_);
+    std::swap(value_, value);
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    // An odd sequence number marks an update in progress.
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    // Orders the store above before the stores of the words below, so that
+    // a reader that observes any of them also observes the odd number.
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+    return value;
+  }
+
+ private:
+  static constexpr size_t kWords =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  static std::array<uint64_t, kWords> ToWords(const T& value) noexcept {
+    std::array<uint64_t, kWords> words = {};
+    std::memcpy(words.data(), static_cast<const void*>(&value), sizeof(T));
+    return words;
+  }
+
+  // Copies the current value into `value`, retrying while an `Update` is in
+  // progress. Returns the sequence number of the copied value.
+  //
+  // The value is stored in atomic words and copied with relaxed loads, since
+  // a plain copy racing with `Update` would be undefined behavior.
+  uint64_t Load(T& value) const noexcept {
+    std::array<uint64_t, kWords> words;
+    while (true) {
+      const uint64_t before = sequence_.load(std::memory_order_acquire);
+      if (before % 2 == 0) {
+        for (size_t i = 0; i < kWords; i++) {
+          words[i] = words_[i].load(std::memory_order_relaxed);
+        }
+        // Orders the loads above before the load below. Pairs with the fence
+        // in `Update`.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) {
+          std::memcpy(static_cast<void*>(&value), words.data(), sizeof(T));
+          return before;
+        }
+      }
+    }
+  }
+
+  // Serializes `Update` calls.
+  absl::Mutex lock_;
+  // The current value, as returned by `Update`.
+  T value_ GUARDED_BY(lock_);
+  // Incremented twice by each `Update`, before and after modifying `words_`.
+  std::atomic<uint64_t> sequence_;
+  // The current value as seen by readers.
+  std::array<std::atomic<uint64_t>, kWords> words_;
+  // Must be the last member, see `ThreadLocalLocals`.
+  ThreadLocalLocals<SeqlockRcu> thread_locals_;
+};
+
+template <typename T>
+constexpr size_t SeqlockRcu<T>::kWords;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_SEQLOCK_RCU_H
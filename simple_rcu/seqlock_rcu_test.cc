@@ -0,0 +1,95 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/seqlock_rcu.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(SeqlockRcuTest, UpdateAndRead) {
+  SeqlockRcu<int> rcu(1);
+  SeqlockRcu<int>::Local local(rcu);
+  EXPECT_EQ(*local.Read(), 1);
+  EXPECT_EQ(rcu.Update(2), 1);
+  EXPECT_EQ(*local.Read(), 2);
+  SeqlockRcu<int>::Local other(rcu);
+  EXPECT_EQ(*other.Read(), 2);
+}
+
+TEST(SeqlockRcuTest, SnapshotIsStable) {
+  SeqlockRcu<int> rcu(1);
+  SeqlockRcu<int>::Local local(rcu);
+  auto snapshot = local.Read();
+  rcu.Update(2);
+  EXPECT_EQ(*snapshot, 1);
+  EXPECT_EQ(*local.Read(), 1) << "Nested snapshots must keep the value";
+  auto copy = snapshot;
+  EXPECT_EQ(*copy, 1);
+}
+
+TEST(SeqlockRcuTest, ThreadLocalAccessor) {
+  SeqlockRcu<int> rcu(1);
+  EXPECT_EQ(*rcu.ThreadLocal().Read(), 1);
+  rcu.Update(2);
+  EXPECT_EQ(*rcu.ThreadLocal().Read(), 2);
+  std::thread([&rcu]() { EXPECT_EQ(*rcu.ThreadLocal().Read(), 2); }).join();
+}
+
+// A value larger than an atomic word, so that torn reads would be observable.
+struct Config {
+  Config(int64_t value = 0) { fields.fill(value); }
+
+  std::array<int64_t, 32> fields;
+};
+
+TEST(SeqlockRcuTest, ConcurrentReadsAreConsistent) {
+  static constexpr int kReaders = 3;
+  static constexpr int kUpdates = 10000;
+  SeqlockRcu<Config> rcu;
+  std::atomic<bool> finished(false);
+  std::vector<std::thread> readers;
+  for (int i = 0; i < kReaders; i++) {
+    readers.emplace_back([&]() {
+      SeqlockRcu<Config>::Local local(rcu);
+      int64_t last = 0;
+      while (!finished.load()) {
+        auto snapshot = local.Read();
+        const int64_t first = snapshot->fields[0];
+        for (int64_t field : snapshot->fields) {
+          ASSERT_EQ(field, first) << "Torn read";
+        }
+        ASSERT_GE(first, last) << "Values must not go back";
+        last = first;
+      }
+    });
+  }
+  for (int i = 1; i <= kUpdates; i++) {
+    rcu.Update(Config(i));
+  }
+  finished.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu
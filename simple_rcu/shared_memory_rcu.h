@@ -0,0 +1,355 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_SHARED_MEMORY_RCU_H
+#define _SIMPLE_RCU_SHARED_MEMORY_RCU_H
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/utility/utility.h"
+#include "simple_rcu/local_3state_rcu.h"
+
+namespace simple_rcu {
+
+// A POSIX shared memory segment mapped into the current process.
+class SharedMemorySegment final {
+ public:
+  // Creates a new segment `name` (such as "/metrics") of `size` bytes, filled
+  // with zeros. Returns `nullptr` if it already exists or on any other error.
+  static std::unique_ptr<SharedMemorySegment> Create(const std::string& name,
+                                                     size_t size) {
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+      return nullptr;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      return nullptr;
+    }
+    return Map(fd, size);
+  }
+
+  // Opens an existing segment `name`. Returns `nullptr` on error.
+  static std::unique_ptr<SharedMemorySegment> Open(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat stat;
+    if (fstat(fd, &stat) != 0) {
+      close(fd);
+      return nullptr;
+    }
+    return Map(fd, static_cast<size_t>(stat.st_size));
+  }
+
+  // Creates an unnamed segment of `size` bytes, filled with zeros, which is
+  // shared with child processes created by `fork()` afterwards. Returns
+  // `nullptr` on error.
+  static std::unique_ptr<SharedMemorySegment> Anonymous(size_t size) {
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+    return std::unique_ptr<SharedMemorySegment>(
+        new SharedMemorySegment(data, size));
+  }
+
+  // Removes the name of a segment. Existing mappings stay valid.
+  static bool Unlink(const std::string& name) {
+    return shm_unlink(name.c_str()) == 0;
+  }
+
+  SharedMemorySegment(const SharedMemorySegment&) = delete;
+  SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+  ~SharedMemorySegment() { munmap(data_, size_); }
+
+  void* data() const noexcept { return data_; }
+  size_t size() const noexcept { return size_; }
+
+ private:
+  SharedMemorySegment(void* data, size_t size) : data_(data), size_(size) {}
+
+  static std::unique_ptr<SharedMemorySegment> Map(int fd, size_t size) {
+    void* data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+    return std::unique_ptr<SharedMemorySegment>(
+        new SharedMemorySegment(data, size));
+  }
+
+  void* const data_;
+  const size_t size_;
+};
+
+// Variant of `ReverseRcu<T>` whose `Local` values live in a shared memory
+// segment, so that they can be written by multiple processes and collected
+// by another one, such as a metrics sidecar, without any serialization.
+//
+// The segment holds a fixed number of slots, each a `Local3StateRcu<T>` that
+// uses only indices and lock-free atomics, and therefore works at any address
+// it's mapped at. `T` must be trivially copyable and must not contain
+// pointers, as they'd be meaningless in other processes.
+//
+// If a process exits without destroying its `Local`, the collector notices
+// that its process id doesn't exist any more, and collects and frees the slot
+// as if it had been destroyed.
+//
+// Only a single process may call `Collect()` on a segment at a time.
+template <typename T>
+class SharedMemoryReverseRcu final {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+  static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                "Atomics in shared memory must be lock-free");
+
+ private:
+  static constexpr uint64_t kMagic = 0x736375725f6d6873;
+
+  struct Header {
+    // Set to `kMagic` after the segment has been initialized.
+    std::atomic<uint64_t> magic;
+    uint64_t value_size;
+    uint64_t slots;
+  };
+
+  enum State : uint32_t {
+    kFree,
+    // Claimed by `NewLocal`, not initialized yet.
+    kClaimed,
+    kLive,
+    kDead,
+  };
+
+  struct Slot {
+    Slot() : state(kFree), pid(0), local_rcu() { local_rcu.ForceUpdate(); }
+
+    std::atomic<uint32_t> state;
+    // The process that owns the slot.
+    std::atomic<int32_t> pid;
+    Local3StateRcu<T, /*kAlignToCacheLines=*/true> local_rcu;
+  };
+
+ public:
+  class Local;
+
+  // Holds a (write) reference to the local value of a `Local`, like
+  // `ReverseRcu::Snapshot`.
+  // Thread-compatible (but not thread-safe), reentrant.
+  class Snapshot final {
+   public:
+    Snapshot(Snapshot&& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot(const Snapshot& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot& operator=(Snapshot&&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot() noexcept {
+      if (--registrar_.snapshot_depth_ == 0) {
+        registrar_.slot_.local_rcu.TryRead();
+      }
+    }
+
+    T* operator->() noexcept { return &**this; }
+    T& operator*() noexcept { return registrar_.slot_.local_rcu.Read(); }
+
+   private:
+    Snapshot(Local& registrar) noexcept : registrar_(registrar) {
+      registrar_.snapshot_depth_++;
+    }
+
+    Local& registrar_;
+
+    friend class Local;
+  };
+
+  // Interface to a slot of the segment, owned by a particular writer thread
+  // of the current process.
+  // Construction and destruction are thread-safe operations, but the `Write()`
+  // method is only thread-compatible.
+  class Local final {
+   public:
+    // Wait-free. The remaining value is collected by the next `Collect`.
+    ~Local() { slot_.state.store(kDead, std::memory_order_release); }
+
+    // Obtains a write snapshot to the local value to be collected.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Write() noexcept { return Snapshot(*this); }
+
+    // Equivalent to `*Write() += delta`, see `ReverseRcu::Local::Add`.
+    template <typename U>
+    void Add(U&& delta) {
+      slot_.local_rcu.Read() += std::forward<U>(delta);
+      slot_.local_rcu.TryRead();
+    }
+
+   private:
+    explicit Local(Slot& slot) : slot_(slot), snapshot_depth_(0) {}
+
+    Slot& slot_;
+    int_fast16_t snapshot_depth_;
+
+    friend class SharedMemoryReverseRcu;
+  };
+
+  // The size of a segment with `slots` slots.
+  static size_t SegmentSize(size_t slots) noexcept {
+    return SlotsOffset() + slots * sizeof(Slot);
+  }
+
+  // Initializes `segment` with as many slots as fit into it. Returns `nullptr`
+  // if there is not even a single one. `segment` must outlive the result.
+  static std::unique_ptr<SharedMemoryReverseRcu> Create(
+      SharedMemorySegment& segment) {
+    if (segment.size() < SegmentSize(1)) {
+      return nullptr;
+    }
+    Header* header = new (segment.data()) Header();
+    header->value_size = sizeof(T);
+    header->slots = (segment.size() - SlotsOffset()) / sizeof(Slot);
+    Slot* slots = SlotsOf(segment);
+    for (size_t i = 0; i < header->slots; i++) {
+      new (&slots[i]) Slot();
+    }
+    header->magic.store(kMagic, std::memory_order_release);
+    return std::unique_ptr<SharedMemoryReverseRcu>(
+        new SharedMemoryReverseRcu(*header, slots));
+  }
+
+  // Attaches to a `segment` initialized by `Create`, possibly in another
+  // process. Returns `nullptr` if it hasn't been initialized or if it's been
+  // initialized for a different `T`. `segment` must outlive the result.
+  static std::unique_ptr<SharedMemoryReverseRcu> Attach(
+      SharedMemorySegment& segment) {
+    if (segment.size() < SegmentSize(0)) {
+      return nullptr;
+    }
+    Header* header = static_cast<Header*>(segment.data());
+    if (header->magic.load(std::memory_order_acquire) != kMagic ||
+        header->value_size != sizeof(T) ||
+        segment.size() < SegmentSize(header->slots)) {
+      return nullptr;
+    }
+    return std::unique_ptr<SharedMemoryReverseRcu>(
+        new SharedMemoryReverseRcu(*header, SlotsOf(segment)));
+  }
+
+  size_t slots() const noexcept { return header_.slots; }
+
+  // Claims a free slot for a writer thread of the current process. Returns
+  // `nullptr` if all slots are in use.
+  //
+  // Thread-safe and lock-free.
+  std::unique_ptr<Local> NewLocal() {
+    for (size_t i = 0; i < header_.slots; i++) {
+      uint32_t expected = kFree;
+      if (slots_[i].state.compare_exchange_strong(expected, kClaimed,
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_relaxed)) {
+        slots_[i].pid.store(static_cast<int32_t>(getpid()),
+                            std::memory_order_relaxed);
+        slots_[i].state.store(kLive, std::memory_order_release);
+        return std::unique_ptr<Local>(new Local(slots_[i]));
+      }
+    }
+    return nullptr;
+  }
+
+  // Collects values from all slots of all processes, like
+  // `ReverseRcu::Collect`, and frees slots of destroyed `Local`s and of
+  // processes that no longer exist.
+  //
+  // Thread-safe, but concurrent calls from multiple processes aren't allowed.
+  T Collect() LOCKS_EXCLUDED(lock_) {
+    T result = T();
+    absl::MutexLock mutex(&lock_);
+    for (size_t i = 0; i < header_.slots; i++) {
+      Slot& slot = slots_[i];
+      uint32_t state = slot.state.load(std::memory_order_acquire);
+      if (state == kLive && !ProcessExists(slot.pid.load())) {
+        state = kDead;
+      }
+      if (state == kLive) {
+        // Skip writers that haven't handed over anything, as `ReverseRcu`.
+        if (slot.local_rcu.ReclaimByUpdate() != nullptr) {
+          slot.local_rcu.ForceUpdate();
+          result += absl::exchange(slot.local_rcu.Update(), T());
+        }
+      } else if (state == kDead) {
+        T* in_flight = slot.local_rcu.ReclaimByUpdate();
+        if (in_flight != nullptr) {
+          result += std::move(*in_flight);
+        }
+        result += std::move(slot.local_rcu.Read());
+        // Free the slot only after resetting it, so that a concurrent
+        // `NewLocal` can't claim it before.
+        new (&slot.local_rcu) Local3StateRcu<T, /*kAlignToCacheLines=*/true>();
+        slot.local_rcu.ForceUpdate();
+        slot.pid.store(0, std::memory_order_relaxed);
+        slot.state.store(kFree, std::memory_order_release);
+      }
+    }
+    return result;
+  }
+
+ private:
+  SharedMemoryReverseRcu(Header& header, Slot* slots)
+      : header_(header), slots_(slots), lock_() {}
+
+  static size_t SlotsOffset() noexcept {
+    return (sizeof(Header) + alignof(Slot) - 1) / alignof(Slot) *
+           alignof(Slot);
+  }
+  static Slot* SlotsOf(SharedMemorySegment& segment) noexcept {
+    return reinterpret_cast<Slot*>(static_cast<char*>(segment.data()) +
+                                   SlotsOffset());
+  }
+
+  static bool ProcessExists(int32_t pid) noexcept {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+  }
+
+  Header& header_;
+  Slot* const slots_;
+  // Serializes `Collect` calls within the current process.
+  absl::Mutex lock_;
+};
+
+template <typename T>
+constexpr uint64_t SharedMemoryReverseRcu<T>::kMagic;
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_SHARED_MEMORY_RCU_H
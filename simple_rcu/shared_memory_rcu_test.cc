@@ -0,0 +1,113 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/shared_memory_rcu.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+using Rcu = SharedMemoryReverseRcu<uint64_t>;
+
+// Runs `child()` in a forked process and waits for it to exit.
+template <typename F>
+void RunInChild(F&& child) {
+  pid_t pid = fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    child();
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+}
+
+TEST(SharedMemoryReverseRcuTest, WriteAndCollectInProcess) {
+  std::unique_ptr<SharedMemorySegment> segment =
+      SharedMemorySegment::Anonymous(Rcu::SegmentSize(2));
+  ASSERT_NE(segment, nullptr);
+  std::unique_ptr<Rcu> rcu = Rcu::Create(*segment);
+  ASSERT_NE(rcu, nullptr);
+  EXPECT_EQ(rcu->slots(), 2);
+  std::unique_ptr<Rcu::Local> local1 = rcu->NewLocal();
+  std::unique_ptr<Rcu::Local> local2 = rcu->NewLocal();
+  ASSERT_NE(local1, nullptr);
+  ASSERT_NE(local2, nullptr);
+  EXPECT_EQ(rcu->NewLocal(), nullptr) << "All slots are in use";
+  local1->Add(1);
+  *local2->Write() += 2;
+  EXPECT_EQ(rcu->Collect(), 3);
+  local1.reset();
+  EXPECT_EQ(rcu->Collect(), 0);
+  EXPECT_NE(rcu->NewLocal(), nullptr) << "The slot must have been freed";
+}
+
+TEST(SharedMemoryReverseRcuTest, CollectsFromOtherProcesses) {
+  std::unique_ptr<SharedMemorySegment> segment =
+      SharedMemorySegment::Anonymous(Rcu::SegmentSize(4));
+  ASSERT_NE(segment, nullptr);
+  std::unique_ptr<Rcu> rcu = Rcu::Create(*segment);
+  ASSERT_NE(rcu, nullptr);
+  for (uint64_t i = 1; i <= 3; i++) {
+    RunInChild([&]() {
+      std::unique_ptr<Rcu::Local> local = rcu->NewLocal();
+      if (local == nullptr) {
+        _exit(1);
+      }
+      local->Add(i);
+      local->Add(10 * i);
+      // Exits without destroying `local`, as if the process crashed.
+      local.release();
+    });
+  }
+  EXPECT_EQ(rcu->Collect(), 66) << "Slots of exited processes are collected";
+  ASSERT_NE(rcu->NewLocal(), nullptr);
+  ASSERT_NE(rcu->NewLocal(), nullptr);
+  ASSERT_NE(rcu->NewLocal(), nullptr);
+}
+
+TEST(SharedMemoryReverseRcuTest, NamedSegment) {
+  const std::string name = "/simple_rcu_test_" + std::to_string(getpid());
+  std::unique_ptr<SharedMemorySegment> created =
+      SharedMemorySegment::Create(name, Rcu::SegmentSize(1));
+  ASSERT_NE(created, nullptr);
+  EXPECT_EQ(SharedMemorySegment::Create(name, Rcu::SegmentSize(1)), nullptr)
+      << "The segment already exists";
+  std::unique_ptr<SharedMemorySegment> opened =
+      SharedMemorySegment::Open(name);
+  ASSERT_NE(opened, nullptr);
+  EXPECT_TRUE(SharedMemorySegment::Unlink(name));
+  EXPECT_EQ(Rcu::Attach(*opened), nullptr) << "Not initialized yet";
+  std::unique_ptr<Rcu> writer = Rcu::Create(*created);
+  std::unique_ptr<Rcu> collector = Rcu::Attach(*opened);
+  ASSERT_NE(collector, nullptr);
+  EXPECT_EQ(SharedMemoryReverseRcu<uint32_t>::Attach(*opened), nullptr)
+      << "Initialized for a different type";
+  std::unique_ptr<Rcu::Local> local = writer->NewLocal();
+  ASSERT_NE(local, nullptr);
+  local->Add(42);
+  EXPECT_EQ(collector->Collect(), 42);
+}
+
+}  // namespace
+}  // namespace simple_rcu
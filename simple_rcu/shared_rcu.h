@@ -0,0 +1,223 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_SHARED_RCU_H
+#define _SIMPLE_RCU_SHARED_RCU_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/local_registry.h"
+#include "simple_rcu/thread_local_locals.h"
+
+namespace simple_rcu {
+
+// Alternative to `Rcu<T>` with the same `Local`/`Snapshot` interface, which
+// keeps just a single instance of `T` shared by all readers.
+//
+// `Update` publishes a pointer to a new value in O(1) without copying it to the
+// readers. Readers pick up the new pointer lazily when obtaining their next
+// outermost `Snapshot`. Each `Local` announces the value it uses in a hazard
+// pointer and old values are destroyed only once no `Local` announces them
+// any more (their grace period has passed). Checking the hazard pointers is
+// batched, so that its cost is amortized O(1) per `Update`.
+//
+// Compared to `Rcu<T>`, a read involves an additional indirection to the
+// shared value, and the shared value can't be modified by readers.
+template <typename T>
+class SharedRcu {
+ private:
+  struct Node;
+  // Each `Local` announces in its hazard pointer the value it uses.
+  using Registry =
+      LocalRegistry<std::atomic<const Node*>, /*kReclaimDead=*/true>;
+
+ public:
+  class Local;
+  using MutableT = typename std::remove_const<T>::type;
+
+  static_assert(std::is_move_constructible<MutableT>::value,
+                "T must be move constructible");
+
+  // Holds a read reference to a RCU value for the current thread.
+  // The reference is guaranteed to be stable during the lifetime of `Snapshot`.
+  // Callers are expected to limit the lifetime of `Snapshot` to as short as
+  // possible.
+  // Thread-compatible (but not thread-safe), reentrant.
+  class Snapshot final {
+   public:
+    Snapshot(Snapshot&& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot(const Snapshot& other) noexcept : Snapshot(other.registrar_) {}
+    Snapshot& operator=(Snapshot&&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    ~Snapshot() noexcept { registrar_.snapshot_depth_--; }
+
+    const T* operator->() const noexcept { return &**this; }
+    const T& operator*() const noexcept {
+      return registrar_.hazard().load(std::memory_order_relaxed)->value;
+    }
+
+   private:
+    Snapshot(Local& registrar) noexcept : registrar_(registrar) {
+      if (registrar_.snapshot_depth_++ == 0) {
+        registrar_.Acquire();
+      }
+    }
+
+    Local& registrar_;
+
+    friend class Local;
+  };
+
+  // Interface to the RCU local to a particular reader thread.
+  // Construction and destruction are thread-safe operations, but the `Read()`
+  // method is only thread-compatible. Callers are expected to construct a
+  // separate `Local` instance for each reader thread.
+  class Local final {
+   public:
+    // Thread-safe and lock-free.
+    Local(SharedRcu& rcu)
+        : rcu_(rcu), node_(rcu.threads_.Add(nullptr)), snapshot_depth_(0) {}
+    // Thread-safe and wait-free.
+    ~Local() { Registry::Remove(node_); }
+
+    // Obtains a read snapshot to the current value held by the RCU.
+    // This is a very fast, lock-free and atomic operation.
+    // Thread-compatible, but not thread-safe.
+    Snapshot Read() noexcept { return Snapshot(*this); }
+
+   private:
+    // The value used by this thread. It's kept even after all `Snapshot`
+    // instances are destroyed, so that the next `Snapshot` can skip
+    // re-validation if the value hasn't changed.
+    std::atomic<const Node*>& hazard() noexcept { return node_->value(); }
+
+    // Makes `hazard()` point to the current value of the RCU.
+    void Acquire() noexcept {
+      const Node* current = rcu_.current_.load();
+      // If `hazard()` already points to `current`, it has been validated by a
+      // previous call and `current` can't have been reclaimed since then.
+      while (current != hazard().load(std::memory_order_relaxed)) {
+        hazard().store(current);
+        // Validate that `current` hasn't been retired before the store above
+        // became visible to `Reclaim()`.
+        current = rcu_.current_.load();
+      }
+    }
+
+    SharedRcu& rcu_;
+    typename Registry::Node* const node_;
+    // Incremented with each `Snapshot` instance. Ensures that `Acquire` is
+    // invoked only for the outermost `Snapshot`, keeping its value unchanged
+    // for its whole lifetime.
+    int_fast16_t snapshot_depth_;
+
+    friend class SharedRcu;
+  };
+
+  // Constructs a RCU with an initial value `T()`.
+  SharedRcu() : SharedRcu(MutableT()) {}
+  SharedRcu(MutableT initial_value)
+      : lock_(),
+        current_(new Node(std::move(initial_value))),
+        threads_(),
+        retired_(),
+        reclaim_threshold_(0),
+        thread_locals_(*this) {}
+  // All `Local` instances must be destroyed before.
+  ~SharedRcu() {
+    delete current_.load();
+    for (const Node* node : retired_) {
+      delete node;
+    }
+  }
+
+  // Returns the `Local` instance of the current thread, registering it on
+  // first use. It's unregistered when the thread exits, or just discarded if
+  // this RCU is destroyed first. This avoids managing `Local` instances
+  // manually, in particular for dynamically created RCUs.
+  //
+  // Thread-safe. O(1) and lock-free, except for the first call on a thread.
+  Local& ThreadLocal() { return thread_locals_.Get(); }
+
+  // Makes `value` available to all registered `Local` threads.
+  // The previous value is destroyed once no reader can observe it any more,
+  // by this or a subsequent `Update` call.
+  //
+  // This method isn't tied in any particular way to a `Local` instance
+  // corresponding to the current thread, and can be called also by threads
+  // that have no `Local` instance at all.
+  //
+  // Thread-safe.
+  void Update(MutableT value) LOCKS_EXCLUDED(lock_) {
+    std::unique_ptr<const Node> node(new Node(std::move(value)));
+    absl::MutexLock mutex(&lock_);
+    retired_.push_back(current_.exchange(node.release()));
+    if (retired_.size() > reclaim_threshold_) {
+      Reclaim();
+    }
+  }
+
+ private:
+  struct Node {
+    explicit Node(MutableT value_) : value(std::move(value_)) {}
+
+    const MutableT value;
+  };
+
+  // Destroys all nodes in `retired_` that aren't protected by any `Local`.
+  void Reclaim() EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    std::vector<const Node*> hazards;
+    threads_.ForEach(
+        [&hazards](std::atomic<const Node*>& hazard) {
+          hazards.push_back(hazard.load());
+        },
+        [](std::atomic<const Node*>&) {});
+    std::sort(hazards.begin(), hazards.end());
+    auto protected_end = std::partition(
+        retired_.begin(), retired_.end(), [&hazards](const Node* node) {
+          return std::binary_search(hazards.begin(), hazards.end(), node);
+        });
+    for (auto it = protected_end; it != retired_.end(); ++it) {
+      delete *it;
+    }
+    retired_.erase(protected_end, retired_.end());
+    // Each `Local` protects at most one node. Therefore the next call reclaims
+    // at least half of `retired_` (unless many `Local`s are added in between),
+    // amortizing the cost of `Reclaim()`.
+    reclaim_threshold_ = 2 * hazards.size();
+  }
+
+  absl::Mutex lock_;
+  // The current value available to all thread-`Local` instances. Never null.
+  std::atomic<const Node*> current_;
+  // Registered thread-`Local` instances. Iterated only while holding `lock_`.
+  Registry threads_;
+  // Previous values that might still be observed by some `Local` instances.
+  std::vector<const Node*> retired_ GUARDED_BY(lock_);
+  // `Reclaim()` is called when `retired_` grows over this size.
+  size_t reclaim_threshold_ GUARDED_BY(lock_);
+  // Must be the last member, see `ThreadLocalLocals`.
+  ThreadLocalLocals<SharedRcu> thread_locals_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_SHARED_RCU_H
@@ -0,0 +1,90 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/shared_rcu.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(SharedRcuTest, UpdateAndRead) {
+  SharedRcu<int> rcu;
+  SharedRcu<int>::Local local1(rcu);
+  rcu.Update(42);
+  SharedRcu<int>::Local local2(rcu);
+  EXPECT_EQ(*local1.Read(), 42)
+      << "Thread registered prior Update must receive the value";
+  EXPECT_EQ(*local2.Read(), 42)
+      << "Thread registered after Update must also receive the value";
+}
+
+TEST(SharedRcuTest, UpdateAndReadConst) {
+  SharedRcu<const int> rcu;
+  SharedRcu<const int>::Local local(rcu);
+  rcu.Update(42);
+  EXPECT_EQ(*local.Read(), 42) << "Reader thread must receive a correct value";
+}
+
+TEST(SharedRcuTest, ThreadLocalUpdateAndRead) {
+  static SharedRcu<int> rcu;
+  static thread_local SharedRcu<int>::Local local(rcu);
+  rcu.Update(42);
+  EXPECT_EQ(*local.Read(), 42) << "Thread-local must receive the value";
+}
+
+TEST(SharedRcuTest, ReadRemainsStable) {
+  SharedRcu<int> rcu(42);
+  SharedRcu<int>::Local local(rcu);
+  auto read_ref1 = local.Read();
+  rcu.Update(73);
+  EXPECT_EQ(*read_ref1, 42)
+      << "The first reference must hold its value past Update()";
+  auto read_ref2 = local.Read();
+  EXPECT_EQ(*read_ref1, 42)
+      << "The first reference must hold its value past another Read()";
+  EXPECT_EQ(*read_ref2, 42)
+      << "A nested reference must have the same value as an outer one";
+}
+
+TEST(SharedRcuTest, OldValuesAreReclaimed) {
+  SharedRcu<std::shared_ptr<int>> rcu;
+  SharedRcu<std::shared_ptr<int>>::Local local(rcu);
+  std::weak_ptr<int> observed;
+  {
+    std::shared_ptr<int> value = std::make_shared<int>(42);
+    observed = value;
+    rcu.Update(std::move(value));
+  }
+  {
+    auto read_ref = local.Read();
+    EXPECT_EQ(**read_ref, 42);
+    for (int i = 0; i < 10; i++) {
+      rcu.Update(std::make_shared<int>(i));
+    }
+    EXPECT_FALSE(observed.expired())
+        << "A value observed by a reader must not be reclaimed";
+  }
+  EXPECT_EQ(**local.Read(), 9) << "Reader must advance to the latest value";
+  for (int i = 0; i < 10; i++) {
+    rcu.Update(std::make_shared<int>(i));
+  }
+  EXPECT_TRUE(observed.expired())
+      << "A value no longer observed by any reader must be reclaimed";
+}
+
+}  // namespace
+}  // namespace simple_rcu
@@ -0,0 +1,61 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_STATS_POLICY_H
+#define _SIMPLE_RCU_STATS_POLICY_H
+
+#include <cstddef>
+
+namespace simple_rcu {
+
+// Default statistics policy of `Rcu` and `ReverseRcu`, which records nothing.
+// All its methods are empty and inlined, so that the instrumentation compiles
+// out completely.
+//
+// A policy passed as the `Stats` template parameter instead must provide the
+// same members:
+//
+// - `Time` and `static Time Now()` to take timestamps.
+// - `RecordUpdate(start, locked, end, locals)`, called after each
+//   `Rcu::Update`, `UpdateCoalescing` and `UpdateWith` call releases its lock.
+//   The lock has been waited for from `start` until `locked` and held until
+//   `end` while distributing a value to `locals` registered `Local` instances.
+// - `Reader`, constructible from the policy, held by each `Rcu::Local`. Its
+//   constructor can allocate, unlike `RecordRead` below.
+// - `RecordRead(reader, advanced)`, called by each outermost `Rcu::Snapshot`
+//   with the `Reader` of its `Local`. The `advanced` argument is `true` if the
+//   `Snapshot` obtained a new value. It must be `noexcept`.
+// - `RecordCollect(start, locked, end, locals)`, called after each
+//   `ReverseRcu::Collect`. Its lock has been waited for from `start` until
+//   `locked`, before draining the first chunk of `Local` instances. Values
+//   from `locals` registered `Local` instances have been combined by `end`.
+//
+// All methods must be thread-safe. `RecordRead` is called on the readers' hot
+// path, so it should be fast. See `RcuStats` for an implementation.
+struct NoRcuStats final {
+  struct Time {};
+  struct Reader {
+    explicit Reader(NoRcuStats&) noexcept {}
+  };
+
+  static Time Now() noexcept { return Time(); }
+
+  void RecordUpdate(Time, Time, Time, size_t) noexcept {}
+  void RecordRead(Reader&, bool) noexcept {}
+  void RecordCollect(Time, Time, Time, size_t) noexcept {}
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_STATS_POLICY_H
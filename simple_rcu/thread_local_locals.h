@@ -0,0 +1,157 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_THREAD_LOCAL_LOCALS_H
+#define _SIMPLE_RCU_THREAD_LOCAL_LOCALS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+
+namespace simple_rcu {
+
+// Manages a `R::Local` instance for each thread that uses a given `R`, such
+// as `Rcu<T>` or `ReverseRcu<T>`, registering it lazily on first use.
+//
+// Each thread keeps its `Local` instances in a thread-local map keyed by an
+// unique id of the `ThreadLocalLocals` instance (ids are never reused, unlike
+// addresses). The last used instance is cached, so that repeated lookups of
+// the same `R` don't need to hash at all.
+//
+// A `Local` is destroyed when its thread exits. If `R` is destroyed first, the
+// `Local` is just discarded on thread exit without accessing `R`.
+//
+// `R` must hold `ThreadLocalLocals<R>` as its last member, so that it's
+// destroyed before anything `R::Local` refers to.
+template <typename R>
+class ThreadLocalLocals final {
+ public:
+  using Local = typename R::Local;
+
+  explicit ThreadLocalLocals(R& rcu)
+      : rcu_(rcu), id_(NextId()), anchor_(std::make_shared<Anchor>()) {}
+  ThreadLocalLocals(const ThreadLocalLocals&) = delete;
+  ThreadLocalLocals& operator=(const ThreadLocalLocals&) = delete;
+  ~ThreadLocalLocals() {
+    absl::MutexLock mutex(&anchor_->lock);
+    anchor_->alive = false;
+  }
+
+  // Returns the `Local` instance of the current thread, constructing it if
+  // needed. O(1), and lock-free if the current thread already has it.
+  Local& Get() {
+    Cache& cache = ThreadCache();
+    if (cache.last_id == id_) {
+      return *cache.last_local;
+    }
+    std::unique_ptr<Entry>& slot = cache.entries[id_];
+    if (slot == nullptr) {
+      slot.reset(new Entry(rcu_, anchor_));
+    }
+    Entry* entry = slot.get();
+    cache.Prune();
+    cache.last_id = id_;
+    cache.last_local = &entry->local();
+    return *cache.last_local;
+  }
+
+ private:
+  // Shared by `ThreadLocalLocals` and the `Local` instances of all threads,
+  // so that they can find out if it's still alive.
+  struct Anchor {
+    Anchor() : lock(), alive(true) {}
+
+    absl::Mutex lock;
+    bool alive GUARDED_BY(lock);
+  };
+
+  // Holds the `Local` of a thread.
+  class Entry final {
+   public:
+    Entry(R& rcu, std::shared_ptr<Anchor> anchor)
+        : anchor_(std::move(anchor)) {
+      new (&storage_) Local(rcu);
+    }
+    ~Entry() {
+      absl::MutexLock mutex(&anchor_->lock);
+      // Otherwise `R` has already destroyed everything `Local` refers to, so
+      // skip its destructor.
+      if (anchor_->alive) {
+        local().~Local();
+      }
+    }
+
+    Local& local() noexcept { return *reinterpret_cast<Local*>(&storage_); }
+
+    bool alive() {
+      absl::MutexLock mutex(&anchor_->lock);
+      return anchor_->alive;
+    }
+
+   private:
+    std::shared_ptr<Anchor> anchor_;
+    typename std::aligned_storage<sizeof(Local), alignof(Local)>::type
+        storage_;
+  };
+
+  struct Cache {
+    Cache() : last_id(0), last_local(nullptr), entries(), prune_size(16) {}
+
+    // Discards entries of dead `R` instances, once the number of entries
+    // doubles since the last call, keeping it amortized O(1).
+    void Prune() {
+      if (entries.size() < prune_size) {
+        return;
+      }
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (!it->second->alive()) {
+          entries.erase(it++);
+        } else {
+          ++it;
+        }
+      }
+      prune_size = 2 * entries.size() + 16;
+    }
+
+    // Zero is never used as an id.
+    uint_fast64_t last_id;
+    Local* last_local;
+    absl::flat_hash_map<uint_fast64_t, std::unique_ptr<Entry>> entries;
+    size_t prune_size;
+  };
+
+  static Cache& ThreadCache() {
+    static thread_local Cache cache;
+    return cache;
+  }
+
+  static uint_fast64_t NextId() {
+    static std::atomic<uint_fast64_t> next_id(1);
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  R& rcu_;
+  const uint_fast64_t id_;
+  const std::shared_ptr<Anchor> anchor_;
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_THREAD_LOCAL_LOCALS_H
@@ -0,0 +1,104 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/thread_local_locals.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/notification.h"
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+std::atomic<int> destroyed_locals(0);
+
+// Stands in for `Rcu`.
+class Owner {
+ public:
+  class Local {
+   public:
+    explicit Local(Owner& owner) : owner_(owner) { owner_.live_locals++; }
+    ~Local() {
+      owner_.live_locals--;
+      destroyed_locals++;
+    }
+
+   private:
+    Owner& owner_;
+  };
+
+  Owner() : live_locals(0), locals(*this) {}
+
+  std::atomic<int> live_locals;
+  ThreadLocalLocals<Owner> locals;
+};
+
+TEST(ThreadLocalLocalsTest, SameLocalOnSameThread) {
+  Owner owner1;
+  Owner owner2;
+  Owner::Local* local1 = &owner1.locals.Get();
+  Owner::Local* local2 = &owner2.locals.Get();
+  EXPECT_NE(local1, local2);
+  EXPECT_EQ(&owner1.locals.Get(), local1);
+  EXPECT_EQ(&owner2.locals.Get(), local2);
+  EXPECT_EQ(owner1.live_locals.load(), 1);
+  Owner::Local* other_local = nullptr;
+  std::thread([&]() { other_local = &owner1.locals.Get(); }).join();
+  EXPECT_NE(other_local, local1) << "Each thread must have its own Local";
+}
+
+TEST(ThreadLocalLocalsTest, DestroyedOnThreadExit) {
+  Owner owner;
+  std::thread([&]() {
+    owner.locals.Get();
+    EXPECT_EQ(owner.live_locals.load(), 1);
+  }).join();
+  EXPECT_EQ(owner.live_locals.load(), 0);
+}
+
+TEST(ThreadLocalLocalsTest, DiscardedIfOwnerDestroyedFirst) {
+  std::unique_ptr<Owner> owner(new Owner());
+  absl::Notification registered;
+  absl::Notification owner_destroyed;
+  std::thread thread([&]() {
+    owner->locals.Get();
+    registered.Notify();
+    owner_destroyed.WaitForNotification();
+  });
+  registered.WaitForNotification();
+  owner.reset();
+  const int destroyed_before = destroyed_locals.load();
+  owner_destroyed.Notify();
+  thread.join();
+  EXPECT_EQ(destroyed_locals.load(), destroyed_before)
+      << "Local must not be destroyed after its owner";
+}
+
+TEST(ThreadLocalLocalsTest, ManyDynamicOwners) {
+  for (int i = 0; i < 100; i++) {
+    Owner owner;
+    owner.locals.Get();
+    EXPECT_EQ(owner.live_locals.load(), 1);
+  }
+  Owner owner;
+  owner.locals.Get();
+  EXPECT_EQ(owner.live_locals.load(), 1);
+}
+
+}  // namespace
+}  // namespace simple_rcu
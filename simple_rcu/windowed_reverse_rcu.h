@@ -0,0 +1,159 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _SIMPLE_RCU_WINDOWED_REVERSE_RCU_H
+#define _SIMPLE_RCU_WINDOWED_REVERSE_RCU_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "simple_rcu/reverse_rcu.h"
+
+namespace simple_rcu {
+
+// `ReverseRcu` that keeps the values collected in the last `epochs` epochs, so
+// that it can answer queries such as "the total of the last 10 seconds".
+//
+// Each call to `Advance()`, typically made periodically by a single thread,
+// collects the values written since the previous call as a new epoch, and
+// drops the oldest one. The epochs are kept in a ring that is also the leaf
+// level of a tree of partial sums. Therefore both `Advance()` and `Window(n)`
+// combine only O(log epochs) values, regardless of `n`.
+//
+// In addition to the `ReverseRcu` requirements, `T` must be copyable.
+template <typename T>
+class WindowedReverseRcu {
+ public:
+  static_assert(std::is_copy_constructible<T>::value,
+                "T must be copy constructible");
+
+  // Interface to the RCU, local to a particular writer thread.
+  // See `ReverseRcu::Local`.
+  class Local final {
+   public:
+    explicit Local(WindowedReverseRcu& rcu,
+                   uint_fast32_t writes_per_handoff = 1)
+        : local_(rcu.rcu_, writes_per_handoff) {}
+
+    typename ReverseRcu<T>::Snapshot Write() noexcept {
+      return local_.Write();
+    }
+    template <typename U>
+    void Add(U&& delta) {
+      local_.Add(std::forward<U>(delta));
+    }
+
+   private:
+    typename ReverseRcu<T>::Local local_;
+  };
+
+  // `epochs` must be positive.
+  explicit WindowedReverseRcu(size_t epochs)
+      : rcu_(),
+        lock_(),
+        epochs_(std::max<size_t>(epochs, 1)),
+        leaves_(LeavesFor(epochs_)),
+        tree_(2 * leaves_),
+        advanced_(0) {}
+
+  // Collects the values written since the last call into a new epoch, dropping
+  // the oldest epoch if there are already `epochs` of them.
+  //
+  // Thread-safe.
+  void Advance() LOCKS_EXCLUDED(lock_) {
+    T value = rcu_.Collect();
+    absl::MutexLock mutex(&lock_);
+    size_t node = leaves_ + advanced_ % epochs_;
+    tree_[node] = std::move(value);
+    for (node /= 2; node > 0; node /= 2) {
+      tree_[node] = Sum(tree_[2 * node], tree_[2 * node + 1]);
+    }
+    advanced_++;
+  }
+
+  // Returns the combined value of the last `n` epochs. If fewer epochs have
+  // been collected so far, or `n` is larger than `epochs`, returns all of
+  // them.
+  //
+  // Thread-safe.
+  T Window(size_t n) const LOCKS_EXCLUDED(lock_) {
+    absl::MutexLock mutex(&lock_);
+    n = std::min<uint64_t>({n, epochs_, advanced_});
+    if (n == 0) {
+      return T();
+    }
+    // The latest epoch is at position `end - 1`, older ones precede it, wrapping
+    // around to the end of the ring.
+    const size_t end = (advanced_ - 1) % epochs_ + 1;
+    if (n <= end) {
+      return Range(end - n, end);
+    }
+    T result = Range(0, end);
+    result += Range(epochs_ - (n - end), epochs_);
+    return result;
+  }
+
+  size_t epochs() const noexcept { return epochs_; }
+
+ private:
+  static size_t LeavesFor(size_t epochs) {
+    size_t leaves = 1;
+    while (leaves < epochs) {
+      leaves *= 2;
+    }
+    return leaves;
+  }
+
+  static T Sum(const T& left, const T& right) {
+    T result = left;
+    result += T(right);
+    return result;
+  }
+
+  // Combines the epochs at positions `[begin, end)`.
+  T Range(size_t begin, size_t end) const EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    T result = T();
+    for (begin += leaves_, end += leaves_; begin < end;
+         begin /= 2, end /= 2) {
+      if (begin % 2 == 1) {
+        result += T(tree_[begin++]);
+      }
+      if (end % 2 == 1) {
+        result += T(tree_[--end]);
+      }
+    }
+    return result;
+  }
+
+  ReverseRcu<T> rcu_;
+  mutable absl::Mutex lock_;
+  const size_t epochs_;
+  // The number of leaves of `tree_`, the smallest power of 2 >= `epochs_`.
+  const size_t leaves_;
+  // Binary tree of partial sums stored in an array: `tree_[1]` is the root,
+  // children of `tree_[i]` are `tree_[2 * i]` and `tree_[2 * i + 1]`. Epochs
+  // are stored in leaves `tree_[leaves_ + i]` for `i < epochs_`.
+  std::vector<T> tree_ GUARDED_BY(lock_);
+  // The number of calls to `Advance()` so far.
+  uint64_t advanced_ GUARDED_BY(lock_);
+};
+
+}  // namespace simple_rcu
+
+#endif  // _SIMPLE_RCU_WINDOWED_REVERSE_RCU_H
@@ -0,0 +1,71 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simple_rcu/windowed_reverse_rcu.h"
+
+#include <algorithm>
+
+#include "gtest/gtest.h"
+
+namespace simple_rcu {
+namespace {
+
+TEST(WindowedReverseRcuTest, EmptyWindow) {
+  WindowedReverseRcu<int> rcu(3);
+  EXPECT_EQ(rcu.Window(0), 0);
+  EXPECT_EQ(rcu.Window(3), 0);
+}
+
+TEST(WindowedReverseRcuTest, WindowsOfLastEpochs) {
+  WindowedReverseRcu<int> rcu(3);
+  {
+    WindowedReverseRcu<int>::Local local(rcu);
+    local.Add(1);
+  }
+  rcu.Advance();
+  EXPECT_EQ(rcu.Window(1), 1);
+  EXPECT_EQ(rcu.Window(3), 1) << "Only a single epoch has been collected";
+  for (int i = 2; i <= 5; i++) {
+    {
+      WindowedReverseRcu<int>::Local local(rcu);
+      *local.Write() += i;
+    }
+    rcu.Advance();
+    EXPECT_EQ(rcu.Window(1), i);
+  }
+  // Epochs 3, 4 and 5 remain.
+  EXPECT_EQ(rcu.Window(2), 4 + 5);
+  EXPECT_EQ(rcu.Window(3), 3 + 4 + 5);
+  EXPECT_EQ(rcu.Window(10), 3 + 4 + 5) << "Window must be limited to epochs";
+}
+
+TEST(WindowedReverseRcuTest, AllWindowsAfterWrapping) {
+  static constexpr int kEpochs = 5;
+  WindowedReverseRcu<int> rcu(kEpochs);
+  WindowedReverseRcu<int>::Local local(rcu);
+  for (int i = 1; i <= 17; i++) {
+    local.Add(i);
+    rcu.Advance();
+    for (int n = 1; n <= kEpochs; n++) {
+      int expected = 0;
+      for (int j = std::max(1, i - n + 1); j <= i; j++) {
+        expected += j;
+      }
+      EXPECT_EQ(rcu.Window(n), expected) << "i=" << i << " n=" << n;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace simple_rcu